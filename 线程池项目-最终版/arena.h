@@ -0,0 +1,332 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <new>
+
+
+const size_t ARENA_CHUNK_SIZE = 64 * 1024;   // ÿϵͳڴС
+const size_t ARENA_MIN_BLOCK = 64;           // СĿ飬η
+const int ARENA_CLASS_SIZE = 4;              // Ĺ64 128 256 512
+const int ARENA_FREE_BATCH = 32;             // ߳ͷŵĿܹôٻ߳
+
+// Ķÿ߳һ
+// ύ̷߳䣬߳ͷţ̷߳ĿֱӷŻԼĿ
+// ̷߳Ŀڱ̣ܹ߳һһԻ߳
+// ߳˳arena߳̽ãڴ治ỹϵͳ
+class TaskArena {
+public:
+	// sizeֽڣֱoperator new
+	static void* allocate(size_t size) {
+		int cls = sizeClass(size);
+		if (cls < 0) {
+			Block* block = static_cast<Block*>(::operator new(size + sizeof(Block)));
+			block->owner = nullptr;
+			return block + 1;
+		}
+		return localArena().allocBlock(cls) + 1;
+	}
+
+	// ͷallocateڴ棬̵߳
+	static void deallocate(void* p) {
+		if (p == nullptr) {
+			return;
+		}
+		Block* block = static_cast<Block*>(p) - 1;
+		if (block->owner == nullptr) {
+			::operator delete(block);
+			return;
+		}
+		int cls = (int)block->cls;
+		LocalState& state = localState();
+		if (block->owner == state.arena) {
+			block->next = state.arena->free_[cls];
+			state.arena->free_[cls] = block;
+			return;
+		}
+		RemoteBatch& batch = state.batches[cls];
+		if (batch.owner != block->owner) {
+			flushBatch(batch, cls);
+			batch.owner = block->owner;
+		}
+		block->next = batch.head;
+		batch.head = block;
+		if (batch.tail == nullptr) {
+			batch.tail = block;
+		}
+		if (++batch.count >= ARENA_FREE_BATCH) {
+			flushBatch(batch, cls);
+		}
+	}
+
+	// ѱ߳ŵı̵߳Ŀȫȥ֮߳̿ǰ
+	static void flushRemote() {
+		LocalState& state = localState();
+		for (int i = 0; i < ARENA_CLASS_SIZE; i++) {
+			flushBatch(state.batches[i], i);
+		}
+	}
+
+	TaskArena(const TaskArena&) = delete;
+	TaskArena& operator=(const TaskArena&) = delete;
+
+private:
+	// ͷʱnextʹʱ¼
+	struct alignas(16) Block {
+		TaskArena* owner;          // arenaΪձʾֱoperator new
+		union {
+			Block* next;
+			size_t cls;
+		};
+	};
+
+	// ߳ŵġͬһarenaһ
+	struct RemoteBatch {
+		TaskArena* owner = nullptr;
+		Block* head = nullptr;
+		Block* tail = nullptr;
+		int count = 0;
+	};
+
+	// ֲ߳̾״̬߳˳ʱ黹ŵĿ飬arena߳
+	struct LocalState {
+		TaskArena* arena = nullptr;
+		RemoteBatch batches[ARENA_CLASS_SIZE];
+
+		~LocalState() {
+			for (int i = 0; i < ARENA_CLASS_SIZE; i++) {
+				flushBatch(batches[i], i);
+			}
+			if (arena != nullptr) {
+				std::unique_lock<std::mutex> lock(abandonedMtx());
+				abandoned().push_back(arena);
+			}
+		}
+	};
+
+	TaskArena() :chunkCur_(nullptr), chunkEnd_(nullptr) {
+		for (int i = 0; i < ARENA_CLASS_SIZE; i++) {
+			free_[i] = nullptr;
+			remote_[i].store(nullptr);
+		}
+	}
+
+	// ͷڣsizeֽڷŽĸ񣬷Ų·-1
+	static int sizeClass(size_t size) {
+		size += sizeof(Block);
+		size_t blockSize = ARENA_MIN_BLOCK;
+		for (int i = 0; i < ARENA_CLASS_SIZE; i++, blockSize <<= 1) {
+			if (size <= blockSize) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	static LocalState& localState() {
+		thread_local LocalState state;
+		return state;
+	}
+
+	// Ѿ˳߳arena
+	// new˳ʱ߳
+	static std::vector<TaskArena*>& abandoned() {
+		static std::vector<TaskArena*>* list = new std::vector<TaskArena*>();
+		return *list;
+	}
+	static std::mutex& abandonedMtx() {
+		static std::mutex* mtx = new std::mutex();
+		return *mtx;
+	}
+
+	// ̵߳arenaȽ˳߳µ
+	static TaskArena& localArena() {
+		LocalState& state = localState();
+		if (state.arena == nullptr) {
+			std::unique_lock<std::mutex> lock(abandonedMtx());
+			if (!abandoned().empty()) {
+				state.arena = abandoned().back();
+				abandoned().pop_back();
+			}
+			else {
+				state.arena = new TaskArena();
+			}
+		}
+		return *state.arena;
+	}
+
+	// һCASҵarenaĻ
+	static void flushBatch(RemoteBatch& batch, int cls) {
+		if (batch.head == nullptr) {
+			return;
+		}
+		std::atomic<Block*>& remote = batch.owner->remote_[cls];
+		Block* old = remote.load(std::memory_order_relaxed);
+		do {
+			batch.tail->next = old;
+		} while (!remote.compare_exchange_weak(old, batch.head,
+			std::memory_order_release, std::memory_order_relaxed));
+		batch.head = nullptr;
+		batch.tail = nullptr;
+		batch.count = 0;
+	}
+
+	// ñ̵߳Ŀһջر̻߳Ŀ飬Ӵڴ
+	Block* allocBlock(int cls) {
+		Block* block = free_[cls];
+		if (block == nullptr) {
+			block = remote_[cls].exchange(nullptr, std::memory_order_acquire);
+		}
+		if (block != nullptr) {
+			free_[cls] = block->next;
+		}
+		else {
+			size_t blockSize = ARENA_MIN_BLOCK << cls;
+			if (chunkCur_ == nullptr || (size_t)(chunkEnd_ - chunkCur_) < blockSize) {
+				chunkCur_ = static_cast<char*>(::operator new(ARENA_CHUNK_SIZE));
+				chunkEnd_ = chunkCur_ + ARENA_CHUNK_SIZE;
+			}
+			block = reinterpret_cast<Block*>(chunkCur_);
+			chunkCur_ += blockSize;
+			block->owner = this;
+		}
+		block->cls = cls;
+		return block;
+	}
+
+private:
+	Block* free_[ARENA_CLASS_SIZE];                   // ̷ֻ߳
+	std::atomic<Block*> remote_[ARENA_CLASS_SIZE];    // ̻߳Ŀ
+	char* chunkCur_;     // ǰڴ滹ûгȥĲ
+	char* chunkEnd_;
+};
+
+// TaskArenaװɱ׼ķpromiseĹ״̬ڲ
+template<typename T>
+class ArenaAllocator {
+public:
+	using value_type = T;
+
+	ArenaAllocator() = default;
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>&) {}
+
+	T* allocate(size_t n) {
+		if (alignof(T) > alignof(std::max_align_t)) {
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+		}
+		return static_cast<T*>(TaskArena::allocate(n * sizeof(T)));
+	}
+	void deallocate(T* p, size_t) {
+		if (alignof(T) > alignof(std::max_align_t)) {
+			::operator delete(p, std::align_val_t(alignof(T)));
+			return;
+		}
+		TaskArena::deallocate(p);
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>&) const {
+		return true;
+	}
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>&) const {
+		return false;
+	}
+};
+
+
+// ִڼõʱڴ棬ÿ߳һ
+// ֻܷ䲻ͷţ̳߳reset
+class ScratchArena {
+public:
+	static ScratchArena& local() {
+		thread_local ScratchArena arena;
+		return arena;
+	}
+
+	~ScratchArena() {
+		for (char* chunk : chunks_) {
+			::operator delete(chunk);
+		}
+	}
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+		size_t offset = (align - (size_t)cur_ % align) % align;
+		if (cur_ == nullptr || (size_t)(end_ - cur_) < offset + size) {
+			// Сһĵ
+			size_t chunkSize = size + align > ARENA_CHUNK_SIZE ? size + align : ARENA_CHUNK_SIZE;
+			char* chunk = static_cast<char*>(::operator new(chunkSize));
+			chunks_.push_back(chunk);
+			cur_ = chunk;
+			end_ = chunk + chunkSize;
+			offset = (align - (size_t)cur_ % align) % align;
+		}
+		void* p = cur_ + offset;
+		cur_ += offset + size;
+		return p;
+	}
+
+	void deallocate(void*, size_t) {}
+
+	// ͷűùڴ棬һ´ν
+	void reset() {
+		if (chunks_.empty()) {
+			return;
+		}
+		for (size_t i = 1; i < chunks_.size(); i++) {
+			::operator delete(chunks_[i]);
+		}
+		chunks_.resize(1);
+		cur_ = chunks_[0];
+		end_ = cur_ + ARENA_CHUNK_SIZE;
+	}
+
+private:
+	ScratchArena() :cur_(nullptr), end_(nullptr) {}
+
+	std::vector<char*> chunks_;
+	char* cur_;
+	char* end_;
+};
+
+// ScratchArenaװɱ׼ķʱֱ
+// std::vector<int, ScratchAllocator<int>> v(ThreadPool::workerAllocator());
+template<typename T>
+class ScratchAllocator {
+public:
+	using value_type = T;
+
+	ScratchAllocator(ScratchArena& arena) :arena_(&arena) {}
+	template<typename U>
+	ScratchAllocator(const ScratchAllocator<U>& other) :arena_(other.arena_) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const ScratchAllocator<U>& other) const {
+		return arena_ == other.arena_;
+	}
+	template<typename U>
+	bool operator!=(const ScratchAllocator<U>& other) const {
+		return arena_ != other.arena_;
+	}
+
+private:
+	template<typename U>
+	friend class ScratchAllocator;
+
+	ScratchArena* arena_;
+};
+
+
+#endif // !ARENA_H
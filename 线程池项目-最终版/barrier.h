@@ -0,0 +1,127 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+* example:
+* SpinBarrier barrier(4);
+* // 4̸ִ߳
+* for (int step = 0; step < steps; step++) {
+*	compute(idx, step);
+*	barrier.wait();     // 4̶߳һż
+* }
+*/
+
+const int BARRIER_SPIN_COUNT = 4000;   // ˯֮ǰȴĴ
+const int BARRIER_YIELD_COUNT = 256;   // ʱÿôóһcpu̱߳Ⱥ˶ʱ̲߳
+
+// ȴʱóˮ
+inline void cpuRelax() {
+#if defined(_MSC_VER)
+	_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// Էʹõϣcount̶֮߳һһ
+// 󵽴̰߳Ѽ㲢תλȴ߳̿λ˾ͷأÿ³ʼ
+// ȴʱspinCountλûת˯ߣ̶߳ʱһֻҪԭӲ
+// ˵Ļû壬Ĭֱ˯
+class SpinBarrier {
+public:
+	explicit SpinBarrier(int count, int spinCount = defaultSpinCount()) :
+		expected_(count),
+		arrived_(0),
+		dropped_(0),
+		phase_(0),
+		sleepers_(0),
+		spinCount_(spinCount)
+	{}
+
+	SpinBarrier(const SpinBarrier&) = delete;
+	SpinBarrier& operator=(const SpinBarrier&) = delete;
+
+	// ﲢȴ̵߳
+	void wait() {
+		unsigned phase = phase_.load(std::memory_order_acquire);
+		if (arrive()) {
+			return;
+		}
+		for (int i = 1; i <= spinCount_; i++) {
+			if (phase_.load(std::memory_order_acquire) != phase) {
+				return;
+			}
+			if (i % BARRIER_YIELD_COUNT == 0) {
+				std::this_thread::yield();
+			}
+			else {
+				cpuRelax();
+			}
+		}
+		// ȵǼټλ󵽴߳ȷתλٿû˯ԣᶪʧ֪ͨ
+		sleepers_++;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			cond_.wait(lock, [&]()->bool { return phase_.load() != phase; });
+		}
+		sleepers_--;
+	}
+
+	// ﱾֵȴ˳ִ֮Σ̳߳ǰʱã߳һֱ
+	void arriveAndDrop() {
+		dropped_++;
+		arrive();
+	}
+
+	// Ѿɵ
+	unsigned phase() const {
+		return phase_.load(std::memory_order_acquire);
+	}
+
+	static int defaultSpinCount() {
+		static const int count = std::thread::hardware_concurrency() > 1 ? BARRIER_SPIN_COUNT : 0;
+		return count;
+	}
+
+private:
+	// һεһֲ߳̽true
+	bool arrive() {
+		int expected = expected_.load(std::memory_order_relaxed);
+		if (arrived_.fetch_add(1, std::memory_order_acq_rel) + 1 != expected) {
+			return false;
+		}
+		// һֵ߳ҪȿλŻᵽ޸ļǰȫ
+		arrived_.store(0, std::memory_order_relaxed);
+		expected_.store(expected - dropped_.exchange(0), std::memory_order_relaxed);
+		phase_++;
+		if (sleepers_.load() > 0) {
+			std::unique_lock<std::mutex> lock(mtx_);
+			cond_.notify_all();
+		}
+		return true;
+	}
+
+private:
+	std::atomic_int expected_;     // ÿҪ߳
+	std::atomic_int arrived_;      // Ѿ
+	std::atomic_int dropped_;      // ˳һֿʼЧ
+	std::atomic<unsigned> phase_;  // ÿһּһ
+	std::atomic_int sleepers_;     // ˯ߵȴ߳
+	int spinCount_;
+
+	std::mutex mtx_;
+	std::condition_variable cond_;
+};
+
+
+#endif // !BARRIER_H
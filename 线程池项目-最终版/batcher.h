@@ -0,0 +1,326 @@
+#ifndef BATCHER_H
+#define BATCHER_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <optional>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include "threadpool.h"
+
+/*
+* example:
+* ThreadPool pool;
+* pool.start(4);
+* // ͬһkeyܳһһβ
+* Batcher<int, std::string, int> lookup(pool, 64, std::chrono::microseconds(200),
+*	[](const int& table, std::string* keys, int* values, size_t n) {
+*		for (size_t i = 0; i < n; i++) { values[i] = find(table, keys[i]); }
+*	});
+* std::future<int> v = lookup.submit(3, "abc");
+* lookup.submit(3, "def", [](int&& value) { std::cout << value << std::endl; });
+*/
+// ΢СȷŽύ߳ԼĻͬһkeyܹmaxBatch
+// һmaxDelayΪһ񽻸̳߳أhandlerһδ
+// ÿͨfuture߻صõԼĽ
+// ʱûȫύȴִ꣬ڼ䲻submit
+template<typename Key, typename In, typename Out, typename Pool = ThreadPool>
+class Batcher {
+public:
+	// һitemsresultsnresultsѾĬϹ
+	using Handler = std::function<void(const Key&, In*, Out*, size_t)>;
+	// Ľص쳣ʱ
+	using Callback = std::function<void(Out&&)>;
+
+	Batcher(Pool& pool, size_t maxBatch, std::chrono::microseconds maxDelay, Handler handler) :
+		pool_(pool),
+		maxBatch_(maxBatch < 1 ? 1 : maxBatch),
+		maxDelay_(maxDelay),
+		handler_(std::move(handler)),
+		id_(nextId()),
+		alive_(std::make_shared<int>(0)),
+		pendingBuffers_(0),
+		inFlight_(0),
+		stop_(false)
+	{
+		timer_ = std::thread(&Batcher::timerFunc, this);
+	}
+
+	~Batcher() {
+		{
+			std::unique_lock<std::mutex> lock(timerMtx_);
+			stop_ = true;
+			timerCond_.notify_all();
+		}
+		timer_.join();
+		flush();
+		std::unique_lock<std::mutex> lock(doneMtx_);
+		doneCond_.wait(lock, [&]()->bool { return inFlight_.load() == 0; });
+	}
+
+	Batcher(const Batcher&) = delete;
+	Batcher& operator=(const Batcher&) = delete;
+
+	// ύһͨfutureý
+	std::future<Out> submit(const Key& key, In item) {
+		std::promise<Out> promise(std::allocator_arg, ArenaAllocator<Out>());
+		std::future<Out> result = promise.get_future();
+		add(key, std::move(item), Waiter{ std::move(promise), nullptr });
+		return result;
+	}
+
+	// ύһ񣬽callbackcallbackڹִ߳У׳쳣̳߳ص쳣
+	void submit(const Key& key, In item, Callback callback) {
+		add(key, std::move(item), Waiter{ std::nullopt, std::move(callback) });
+	}
+
+	// ߳ŵύȴִ
+	void flush() {
+		std::unique_lock<std::mutex> lock(registryMtx_);
+		for (auto& buf : registry_) {
+			std::unique_lock<std::mutex> bufLock(buf->mtx);
+			if (!buf->items.empty()) {
+				dispatch(take(*buf));
+			}
+		}
+	}
+
+private:
+	// һĽȥpromisecallbackֻһ
+	struct Waiter {
+		std::optional<std::promise<Out>> promise;
+		Callback callback;
+	};
+
+	// ŵһִ̳߳
+	struct Batch {
+		Key key;
+		std::vector<In> items;
+		std::vector<Waiter> waiters;
+	};
+
+	// һ߳һkeyĻ
+	// ƽʱ̷ֻ߳ʣֻڶʱ̺߳flushȡʱо
+	struct Buffer {
+		explicit Buffer(const Key& k) :key(k) {}
+
+		Key key;
+		std::mutex mtx;
+		std::vector<In> items;
+		std::vector<Waiter> waiters;
+		std::chrono::steady_clock::time_point first;   // һŽʱ
+	};
+
+	// ÿBatcherһţֲ߳̾ĻŲңѾBatcher
+	static uint64_t nextId() {
+		static std::atomic<uint64_t> id(0);
+		return ++id;
+	}
+
+	void add(const Key& key, In&& item, Waiter&& waiter) {
+		Buffer& buf = localBuffer(key);
+		std::unique_lock<std::mutex> lock(buf.mtx);
+		if (buf.items.empty()) {
+			buf.first = std::chrono::steady_clock::now();
+			// ûдύĻʱʱ߳˯ߣҪʼʱ
+			if (pendingBuffers_.fetch_add(1) == 0) {
+				std::unique_lock<std::mutex> timerLock(timerMtx_);
+				timerCond_.notify_all();
+			}
+		}
+		buf.items.emplace_back(std::move(item));
+		buf.waiters.emplace_back(std::move(waiter));
+		if (buf.items.size() >= maxBatch_) {
+			dispatch(take(buf));
+		}
+	}
+
+	// һ߳һBatcherϵлBatcheraliveʧЧ
+	struct LocalBuffers {
+		std::weak_ptr<void> alive;
+		std::unordered_map<Key, std::shared_ptr<Buffer>> buffers;
+	};
+
+	// ǰ߳keyϵĻһʱǼ
+	// ̵߳һĳBatcherʱ˳ͷѾBatcherµĻ
+	Buffer& localBuffer(const Key& key) {
+		thread_local std::unordered_map<uint64_t, LocalBuffers> local;
+		auto it = local.find(id_);
+		if (it == local.end()) {
+			for (auto dead = local.begin(); dead != local.end();) {
+				if (dead->second.alive.expired()) {
+					dead = local.erase(dead);
+				}
+				else {
+					++dead;
+				}
+			}
+			it = local.emplace(id_, LocalBuffers{ alive_, {} }).first;
+		}
+		std::shared_ptr<Buffer>& buf = it->second.buffers[key];
+		if (buf == nullptr) {
+			buf = std::make_shared<Buffer>(key);
+			buf->items.reserve(maxBatch_);
+			buf->waiters.reserve(maxBatch_);
+			std::unique_lock<std::mutex> lock(registryMtx_);
+			registry_.push_back(buf);
+		}
+		return *buf;
+	}
+
+	// ȡ߻Ҫbuf.mtx
+	Batch take(Buffer& buf) {
+		Batch batch{ buf.key, std::move(buf.items), std::move(buf.waiters) };
+		buf.items.clear();
+		buf.waiters.clear();
+		buf.items.reserve(maxBatch_);
+		buf.waiters.reserve(maxBatch_);
+		pendingBuffers_--;
+		return batch;
+	}
+
+	// Ϊһ񽻸̳߳
+	// ύʧܻ߱DISCARDرնΣյbroken_promiseһֱ
+	void dispatch(Batch&& batch) {
+		inFlight_++;
+		auto shared = std::make_shared<Batch>(std::move(batch));
+		TaskDropGuard guard([this, shared]() {
+			fail(*shared, std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+			batchDone();
+			});
+		pool_.enqueueTask([this, shared, guard = std::move(guard)]() mutable {
+			guard.dismiss();
+			run(*shared);
+			batchDone();
+			});
+	}
+
+	// һνһνʱ
+	// doneMtx_¼õ֮ǰѾſ֮ٷthis
+	void batchDone() {
+		std::unique_lock<std::mutex> lock(doneMtx_);
+		if (--inFlight_ == 0) {
+			doneCond_.notify_all();
+		}
+	}
+
+	void run(Batch& batch) {
+		std::vector<Out> results(batch.items.size());
+		try {
+			handler_(batch.key, batch.items.data(), results.data(), batch.items.size());
+		}
+		catch (...) {
+			fail(batch, std::current_exception());
+			return;
+		}
+		for (size_t i = 0; i < batch.waiters.size(); i++) {
+			Waiter& waiter = batch.waiters[i];
+			if (waiter.promise) {
+				waiter.promise->set_value(std::move(results[i]));
+			}
+			else if (waiter.callback) {
+				// һص쳣Ӱͬһ񣬽̳߳ص쳣
+				try {
+					waiter.callback(std::move(results[i]));
+				}
+				catch (...) {
+					pool_.handleException(std::current_exception());
+				}
+			}
+		}
+	}
+
+	// ʧܣfutureյ쳣صûа취֪̳ͨ߳ص쳣
+	void fail(Batch& batch, std::exception_ptr error) {
+		bool lost = false;
+		for (auto& waiter : batch.waiters) {
+			if (waiter.promise) {
+				waiter.promise->set_exception(error);
+			}
+			else {
+				lost = true;
+			}
+		}
+		if (lost) {
+			pool_.handleException(error);
+		}
+	}
+
+	// ʱ̣߳ѵȴmaxDelayĻύ˯һ
+	// лǿյľһֱ˯ֱлŽһ
+	void timerFunc() {
+		std::unique_lock<std::mutex> lock(timerMtx_);
+		while (!stop_) {
+			if (pendingBuffers_.load() == 0) {
+				timerCond_.wait(lock, [&]()->bool { return stop_ || pendingBuffers_.load() != 0; });
+				continue;
+			}
+			lock.unlock();
+			auto next = flushExpired();
+			lock.lock();
+			timerCond_.wait_until(lock, next);
+		}
+	}
+
+	// ύѾڵĻһʱ
+	// ֻʣregistry_õĻ˵߳Ѿ˳ȡ֮ɾ
+	std::chrono::steady_clock::time_point flushExpired() {
+		auto now = std::chrono::steady_clock::now();
+		auto next = now + maxDelay_;
+		std::unique_lock<std::mutex> lock(registryMtx_);
+		for (size_t i = 0; i < registry_.size();) {
+			Buffer& buf = *registry_[i];
+			std::unique_lock<std::mutex> bufLock(buf.mtx);
+			if (buf.items.empty()) {
+				if (registry_[i].use_count() == 1) {
+					bufLock.unlock();
+					registry_[i] = std::move(registry_.back());
+					registry_.pop_back();
+					continue;
+				}
+				i++;
+				continue;
+			}
+			auto deadline = buf.first + maxDelay_;
+			if (deadline <= now) {
+				dispatch(take(buf));
+			}
+			else if (deadline < next) {
+				next = deadline;
+			}
+			i++;
+		}
+		return next;
+	}
+
+private:
+	Pool& pool_;
+	size_t maxBatch_;                    // ܹôύ
+	std::chrono::microseconds maxDelay_; // ô
+	Handler handler_;
+	uint64_t id_;
+	std::shared_ptr<void> alive_;        // ֲ߳̾ĻݴжBatcherǷѾ
+
+	std::mutex registryMtx_;
+	std::vector<std::shared_ptr<Buffer>> registry_;   // ̵߳Ļ߳˳ȡ˲ɾ
+	std::atomic_int pendingBuffers_;     // ǿյĻ
+	std::atomic_int inFlight_;           // Ѿ̳߳ػûִ
+	std::mutex doneMtx_;
+	std::condition_variable doneCond_;   // ȫִʱ֪ͨ
+
+	std::thread timer_;
+	std::mutex timerMtx_;
+	std::condition_variable timerCond_;
+	bool stop_;
+};
+
+
+#endif // !BATCHER_H
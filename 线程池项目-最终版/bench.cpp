@@ -0,0 +1,237 @@
+﻿// 线程池的性能测试，和演示程序分开编译：
+// g++ -O2 -std=c++17 -pthread bench.cpp -o bench
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include "threadpool.h"
+#include "taskprofiler.h"
+#include "batcher.h"
+
+using Clock = std::chrono::steady_clock;
+
+const int BENCH_TASK_SIZE = 1000000;
+const int BENCH_THREAD_SIZE = 4;
+
+// 提交大量很小的任务，等全部执行完，返回每个任务的平均耗时(ns)
+template<typename Pool>
+double benchSubmitTask(Pool& pool) {
+    pool.setTaskQueMaxThreadHold(INT32_MAX);
+    pool.start(BENCH_THREAD_SIZE);
+
+    std::atomic<int> done(0);
+    auto begin = Clock::now();
+    for (int i = 0; i < BENCH_TASK_SIZE; i++) {
+        pool.submitTask([&done]() { done++; });
+    }
+    pool.awaitIdle();
+    auto end = Clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / BENCH_TASK_SIZE;
+}
+
+template<typename Pool>
+double benchSubmitTask() {
+    Pool pool;
+    return benchSubmitTask(pool);
+}
+
+// 策略组合：运行时判断fixed模式的默认线程池 vs 编译期精简的线程池
+void benchPolicy() {
+    std::cout << "==== policy: " << BENCH_TASK_SIZE << " tasks, "
+        << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    std::cout << "ThreadPool(fixed mode)   " << benchSubmitTask<ThreadPool>() << " ns/task" << std::endl;
+    std::cout << "FixedThreadPool          " << benchSubmitTask<FixedThreadPool>() << " ns/task" << std::endl;
+    std::cout << "FixedThreadPool+SpinWait "
+        << benchSubmitTask<BasicThreadPool<FifoQueue, SpinWait, FixedSizing, NoMetrics>>() << " ns/task" << std::endl;
+}
+
+// 性能剖析的开销：不剖析 vs 采样 vs 每个任务都剖析
+void benchProfiler() {
+    std::cout << "==== profiler: " << BENCH_TASK_SIZE << " tasks, "
+        << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    std::cout << "ThreadPool               " << benchSubmitTask<ThreadPool>() << " ns/task" << std::endl;
+    int rates[] = { 0, 64, 1 };
+    for (int rate : rates) {
+        ProfiledThreadPool pool;
+        pool.getMetrics().profiler().setSampleRate(rate);
+        std::cout << "ProfiledThreadPool 1/" << rate << "    " << benchSubmitTask(pool) << " ns/task" << std::endl;
+    }
+}
+
+// 时间线记录的开销：关闭 vs 打开
+void benchTracer() {
+    std::cout << "==== tracer: " << BENCH_TASK_SIZE << " tasks, "
+        << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    std::cout << "tracing off              " << benchSubmitTask<ThreadPool>() << " ns/task" << std::endl;
+    TaskTracer::start();
+    std::cout << "tracing on               " << benchSubmitTask<ThreadPool>() << " ns/task" << std::endl;
+    TaskTracer::stop();
+}
+
+// 很小的任务：逐个submitTask vs 攒成批次，结果都通过回调累加
+void benchBatcher() {
+    std::cout << "==== batcher: " << BENCH_TASK_SIZE << " tasks, "
+        << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    std::cout << "submitTask               " << benchSubmitTask<ThreadPool>() << " ns/task" << std::endl;
+
+    ThreadPool pool;
+    pool.setTaskQueMaxThreadHold(INT32_MAX);
+    pool.start(BENCH_THREAD_SIZE);
+    std::atomic<long> sum(0);
+    auto begin = Clock::now();
+    {
+        Batcher<int, int, int> batcher(pool, 256, std::chrono::microseconds(100),
+            [](const int&, int* items, int* results, size_t n) {
+                for (size_t i = 0; i < n; i++) {
+                    results[i] = items[i] + 1;
+                }
+            });
+        for (int i = 0; i < BENCH_TASK_SIZE; i++) {
+            batcher.submit(0, i, [&sum](int&& v) { sum += v; });
+        }
+    }   // 析构时提交剩下的并等待执行完
+    auto end = Clock::now();
+    std::cout << "Batcher(256, 100us)      "
+        << std::chrono::duration<double, std::nano>(end - begin).count() / BENCH_TASK_SIZE << " ns/task" << std::endl;
+}
+
+// 多个提交线程同时提交：共享任务队列 vs 每个提交线程自己的缓冲区
+double benchProducers(int bufferSize) {
+    const int producerSize = 8;
+    ThreadPool pool;
+    pool.setTaskQueMaxThreadHold(INT32_MAX);
+    pool.setProducerBufferSize(bufferSize);
+    pool.start(BENCH_THREAD_SIZE);
+
+    std::atomic<int> done(0);
+    auto begin = Clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerSize; p++) {
+        producers.emplace_back([&]() {
+            for (int i = 0; i < BENCH_TASK_SIZE / producerSize; i++) {
+                pool.submitTask([&done]() { done++; });
+            }
+        });
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    pool.awaitIdle();
+    auto end = Clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / BENCH_TASK_SIZE;
+}
+
+void benchProducerBuffer() {
+    std::cout << "==== producer buffer: " << BENCH_TASK_SIZE << " tasks, 8 producers, "
+        << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    std::cout << "shared queue             " << benchProducers(0) << " ns/task" << std::endl;
+    std::cout << "producer buffer(1024)    " << benchProducers(1024) << " ns/task" << std::endl;
+}
+
+// 不需要结果的任务：submitTask vs post
+void benchPost() {
+    std::cout << "==== post: " << BENCH_TASK_SIZE << " void tasks, "
+        << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    std::cout << "submitTask               " << benchSubmitTask<ThreadPool>() << " ns/task" << std::endl;
+
+    ThreadPool pool;
+    pool.setTaskQueMaxThreadHold(INT32_MAX);
+    pool.start(BENCH_THREAD_SIZE);
+    std::atomic<int> done(0);
+    auto begin = Clock::now();
+    for (int i = 0; i < BENCH_TASK_SIZE; i++) {
+        pool.post([&done]() { done++; });
+    }
+    pool.awaitIdle();
+    auto end = Clock::now();
+    std::cout << "post                     "
+        << std::chrono::duration<double, std::nano>(end - begin).count() / BENCH_TASK_SIZE << " ns/task" << std::endl;
+}
+
+// 一次只提交一个任务，测从提交到任务开始执行的延迟，返回所有样本(ns)
+std::vector<uint64_t> benchLatency(int spinWorkers) {
+    const int sampleSize = 100000;
+    ThreadPool pool;
+    pool.setSpinWorkerSize(spinWorkers);
+    pool.start(BENCH_THREAD_SIZE);
+
+    std::vector<uint64_t> samples(sampleSize);
+    std::atomic<int> done(0);
+    for (int i = 0; i < sampleSize; i++) {
+        auto submit = Clock::now();
+        pool.submitTask([&samples, &done, submit, i]() {
+            samples[i] = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - submit).count();
+            done.store(i + 1, std::memory_order_release);
+        });
+        // 等上一个任务开始执行了再提交下一个，测的是空闲线程池的交接延迟
+        while (done.load(std::memory_order_acquire) != i + 1) {
+            std::this_thread::yield();
+        }
+    }
+    pool.awaitIdle();
+    std::sort(samples.begin(), samples.end());
+    return samples;
+}
+
+// 交接延迟：任务队列+条件变量唤醒 vs 直接写进自旋线程的信箱
+void benchHandoff() {
+    std::cout << "==== handoff latency: " << BENCH_THREAD_SIZE << " threads ====" << std::endl;
+    const char* names[] = { "queue + condvar          ", "1 spin worker            " };
+    for (int spin = 0; spin <= 1; spin++) {
+        std::vector<uint64_t> samples = benchLatency(spin);
+        auto at = [&](double p) { return samples[(size_t)(p * (samples.size() - 1))]; };
+        std::cout << names[spin] << "p50 " << at(0.5) << "ns  p90 " << at(0.9) << "ns  p99 " << at(0.99)
+            << "ns  p99.9 " << at(0.999) << "ns" << std::endl;
+    }
+}
+
+// 分步同步的循环：每一步提交n个任务再逐个get vs 并行区域里用屏障同步
+void benchRegion() {
+    const int stepSize = 10000;
+    const int n = BENCH_THREAD_SIZE;
+    std::cout << "==== parallel region: " << stepSize << " steps, " << n << " threads ====" << std::endl;
+    std::vector<long> work(n * 16, 0);   // 每个线程的数据隔开一个缓存行
+
+    ThreadPool pool;
+    pool.start(n);
+    auto begin = Clock::now();
+    for (int step = 0; step < stepSize; step++) {
+        std::vector<std::future<void>> results;
+        for (int i = 0; i < n; i++) {
+            results.push_back(pool.submitTask([&work, i]() { work[i * 16]++; }));
+        }
+        for (auto& r : results) {
+            r.get();
+        }
+    }
+    auto end = Clock::now();
+    std::cout << "submitTask + get         "
+        << std::chrono::duration<double, std::nano>(end - begin).count() / stepSize << " ns/step" << std::endl;
+
+    begin = Clock::now();
+    pool.parallelRegion(n, [&work](int idx, SpinBarrier& barrier) {
+        for (int step = 0; step < stepSize; step++) {
+            work[idx * 16]++;
+            barrier.wait();
+        }
+    });
+    end = Clock::now();
+    std::cout << "parallelRegion           "
+        << std::chrono::duration<double, std::nano>(end - begin).count() / stepSize << " ns/step" << std::endl;
+}
+
+int main()
+{
+    benchPolicy();
+    benchProfiler();
+    benchTracer();
+    benchBatcher();
+    benchProducerBuffer();
+    benchHandoff();
+    benchPost();
+    benchRegion();
+    return 0;
+}
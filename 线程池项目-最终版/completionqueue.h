@@ -0,0 +1,203 @@
+#ifndef COMPLETIONQUEUE_H
+#define COMPLETIONQUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "threadpool.h"
+
+/*
+* example:
+* ThreadPool pool;
+* pool.start(4);
+* CompletionQueue<int> cq(pool);
+* for (int i = 0; i < 100; i++) {
+*	cq.submit(sum1, i, i);
+* }
+* CompletionQueue<int>::Completion c;
+* while (cq.pop(c)) {   // ɵȺ˳ȡ
+*	std::cout << c.id << ": " << c.get() << std::endl;
+* }
+*/
+// ɶУִѽ쳣ŽһĶߵ߶У
+// ʹ߰˳ȡҪÿһfuture
+// ͬһʱֻһ߳ȡ
+template<typename T, typename Pool = ThreadPool>
+class CompletionQueue {
+	// voidڶboolռλ
+	using Value = std::conditional_t<std::is_void<T>::value, bool, T>;
+
+public:
+	// һִн
+	struct Completion {
+		size_t id = 0;                 // submitص
+		std::optional<Value> value;    // صֵ
+		std::exception_ptr error;      // ׳쳣
+
+		// ȡ쳣׳
+		T get() {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+			if constexpr (!std::is_void<T>::value) {
+				return std::move(*value);
+			}
+		}
+	};
+
+	explicit CompletionQueue(Pool& pool) :
+		pool_(pool),
+		nextId_(0),
+		pending_(0),
+		inFlight_(0),
+		sleeping_(false)
+	{
+		tail_ = new Node();
+		head_.store(tail_);
+	}
+
+	// ȴѾͶݵ񶼰ѽŽͷûȡߵĽ
+	~CompletionQueue() {
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			cond_.wait(lock, [&]()->bool { return inFlight_.load() == 0; });
+		}
+		while (tail_ != nullptr) {
+			Node* next = tail_->next.load();
+			delete tail_;
+			tail_ = next;
+		}
+	}
+
+	CompletionQueue(const CompletionQueue&) = delete;
+	CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+	// ύ񣬷ţڱ
+	// ̳߳ύʧܣDISCARDرնһbroken_promise쳣Ľ
+	template<typename Func, typename... Args>
+	size_t submit(Func&& func, Args&&... args) {
+		size_t id = nextId_++;
+		pending_++;
+		inFlight_++;
+		auto fn = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+		// ûִоͱͷʱҲҪpop()һֱ
+		TaskDropGuard guard([this, id]() {
+			Node* node = new Node();
+			node->item.id = id;
+			node->item.error = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+			push(node);
+			});
+		pool_.enqueueTask([this, id, fn, guard = std::move(guard)]() mutable {
+			guard.dismiss();
+			Node* node = new Node();
+			node->item.id = id;
+			try {
+				if constexpr (std::is_void<T>::value) {
+					fn();
+					node->item.value.emplace(true);
+				}
+				else {
+					node->item.value.emplace(fn());
+				}
+			}
+			catch (...) {
+				node->item.error = std::current_exception();
+			}
+			push(node);
+			});
+		return id;
+	}
+
+	// ȡһûɵĽfalse
+	bool tryPop(Completion& out) {
+		Node* tail = tail_;
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (next == nullptr) {
+			return false;
+		}
+		out = std::move(next->item);
+		tail_ = next;
+		delete tail;
+		pending_--;
+		return true;
+	}
+
+	// ȡһύĽѾȡ˷false
+	bool pop(Completion& out) {
+		for (;;) {
+			if (tryPop(out)) {
+				return true;
+			}
+			if (pending_.load() == 0) {
+				return false;
+			}
+			std::unique_lock<std::mutex> lock(mtx_);
+			sleeping_.store(true);
+			cond_.wait(lock, [&]()->bool { return tail_->next.load() != nullptr; });
+			sleeping_.store(false);
+		}
+	}
+
+	// ȡǰɵĽ׷ӵoutȡĸ
+	size_t drain(std::vector<Completion>& out, size_t maxCount = SIZE_MAX) {
+		size_t n = 0;
+		Completion c;
+		while (n < maxCount && tryPop(c)) {
+			out.emplace_back(std::move(c));
+			n++;
+		}
+		return n;
+	}
+
+	// ύûȡߵĽ
+	size_t pending() const {
+		return pending_.load();
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next{ nullptr };
+		Completion item;
+	};
+
+	// ߣֻ̣߳һԭӽ
+	void push(Node* node) {
+		Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node);
+		// ˯ߣһ;ڵȣҪ
+		// ʱõ֮Ż᷵أ֮ٷthis
+		size_t n = inFlight_.load();
+		for (;;) {
+			if (n == 1 || sleeping_.load()) {
+				std::unique_lock<std::mutex> lock(mtx_);
+				inFlight_--;
+				cond_.notify_all();
+				return;
+			}
+			if (inFlight_.compare_exchange_weak(n, n - 1)) {
+				return;
+			}
+		}
+	}
+
+private:
+	Pool& pool_;
+	std::atomic<Node*> head_;       // ߴ
+	Node* tail_;                    // ߴȡtail_Ѿȡڱڵ
+	std::atomic<size_t> nextId_;
+	std::atomic<size_t> pending_;   // ύûȡߵĽ
+	std::atomic<size_t> inFlight_;  // ύû
+
+	std::mutex mtx_;                // ֻ˯ߺȴʱʹ
+	std::condition_variable cond_;
+	std::atomic_bool sleeping_;
+};
+
+
+#endif // !COMPLETIONQUEUE_H
@@ -0,0 +1,377 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <string>
+#include "threadpool.h"
+
+/*
+* example:
+* ThreadPool pool;
+* pool.start(4);
+* int n = 0;
+* Pipeline<>::source<int>(pool, 16, [&](int& out) { out = n++; return n <= 1000; })
+*	.then(StageMode::PARALLEL_ORDERED, 2, [](int&& x) { return std::to_string(x); })
+*	.sink(StageMode::SERIAL, 1, [](std::string&& s) { std::cout << s << std::endl; })
+*	.run();
+*
+* ÿ׶εÿһ·᳤ռ̳߳һ̣߳
+* ̳߳ص߳Ҫн׶β֮ͣcachedģʽ߳㣩ʱrun()ֱ쳣
+*/
+
+// ˮ߽׶εִзʽ
+enum class StageMode {
+	SERIAL,            // д˳
+	PARALLEL,          // д˳򲻱֤
+	PARALLEL_ORDERED   // д˳
+};
+
+// ׶֮н绺Դγɷѹ
+// tokenֻƶҪĬϹ
+template<typename T>
+class Channel {
+public:
+	Channel(size_t capacity, int producers) :
+		capacity_(capacity),
+		producers_(producers),
+		popSeq_(0),
+		closed_(false),
+		aborted_(false)
+	{}
+
+	// һtokenֹͨʱfalse
+	bool push(T&& item) {
+		std::unique_lock<std::mutex> lock(mtx_);
+		notFull_.wait(lock, [&]()->bool { return aborted_ || que_.size() < capacity_; });
+		if (aborted_) {
+			return false;
+		}
+		que_.push_back(std::move(item));
+		notEmpty_.notify_one();
+		return true;
+	}
+
+	// ȡһtokenͬʱȡڱͨĳţ
+	// ͨرȡգֹ߱false
+	bool pop(T& item, size_t& seq) {
+		std::unique_lock<std::mutex> lock(mtx_);
+		notEmpty_.wait(lock, [&]()->bool { return aborted_ || closed_ || !que_.empty(); });
+		if (aborted_ || que_.empty()) {
+			return false;
+		}
+		item = std::move(que_.front());
+		que_.pop_front();
+		seq = popSeq_++;
+		notFull_.notify_one();
+		return true;
+	}
+
+	// һ߽ȫ߽ͨر
+	void producerDone() {
+		std::unique_lock<std::mutex> lock(mtx_);
+		if (--producers_ == 0) {
+			closed_ = true;
+			notEmpty_.notify_all();
+		}
+	}
+
+	// ʱֹͨϵ߳
+	void abort() {
+		std::unique_lock<std::mutex> lock(mtx_);
+		aborted_ = true;
+		notFull_.notify_all();
+		notEmpty_.notify_all();
+	}
+
+private:
+	std::deque<T> que_;
+	size_t capacity_;      // 
+	int producers_;        // û
+	size_t popSeq_;        // һ
+	bool closed_;
+	bool aborted_;
+
+	std::mutex mtx_;
+	std::condition_variable notFull_;
+	std::condition_variable notEmpty_;
+};
+
+// ׶εķֵ˲
+class Sequencer {
+public:
+	Sequencer() :next_(0), aborted_(false) {}
+
+	// ȴֵseqֹfalse
+	bool waitTurn(size_t seq) {
+		std::unique_lock<std::mutex> lock(mtx_);
+		cond_.wait(lock, [&]()->bool { return aborted_ || next_ == seq; });
+		return !aborted_;
+	}
+
+	// ǰϣֵһ
+	void advance() {
+		std::unique_lock<std::mutex> lock(mtx_);
+		next_++;
+		cond_.notify_all();
+	}
+
+	void abort() {
+		std::unique_lock<std::mutex> lock(mtx_);
+		aborted_ = true;
+		cond_.notify_all();
+	}
+
+private:
+	size_t next_;
+	bool aborted_;
+	std::mutex mtx_;
+	std::condition_variable cond_;
+};
+
+// ˮߵĹ״̬׶εִ壬Լʱֹ
+template<typename Pool = ThreadPool>
+struct PipelineState {
+	PipelineState(Pool& pool, size_t capacity) :pool_(pool), capacity_(capacity) {}
+
+	// ¼һ쳣ֹͨ׶ξ˳
+	void fail(std::exception_ptr e) {
+		std::vector<std::function<void()>> aborters;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			if (!error_) {
+				error_ = e;
+			}
+			aborters = aborters_;
+		}
+		for (auto& abort : aborters) {
+			abort();
+		}
+	}
+
+	Pool& pool_;
+	size_t capacity_;        // ׶֮仺
+	std::vector<std::function<void()>> runners_;   // ÿһ·Ӧһִ
+	std::vector<std::function<void()>> aborters_;
+	std::exception_ptr error_;
+	std::mutex mtx_;
+};
+
+template<typename T, typename Pool>
+class PipelineStage;
+
+// ɵˮ
+template<typename Pool = ThreadPool>
+class Pipeline {
+public:
+	// Դ׶Σgenÿһtokenfalseʾ
+	template<typename T, typename Gen>
+	static PipelineStage<T, Pool> source(Pool& pool, size_t capacity, Gen gen);
+
+	// н׶ύ̳߳أˮ꣬н׶쳣׳
+	// ÿִ嶼Ҫռһ̣̳߳߳ص̲߳ʱһύֱ쳣ụȴ
+	void run() {
+		int workers = state_->pool_.availableWorkerSize();
+		if ((int)state_->runners_.size() > workers) {
+			throw std::runtime_error("pipeline needs " + std::to_string(state_->runners_.size()) +
+				" workers, only " + std::to_string(workers) + " available in the pool");
+		}
+
+		std::vector<std::future<bool>> results;
+		for (auto& runner : state_->runners_) {
+			// ύʧʱ̳߳طصĬֵfalse
+			std::future<bool> res = state_->pool_.submitTask([runner]()->bool {
+				runner();
+				return true;
+				});
+			if (res.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				if (!res.get()) {
+					state_->fail(std::make_exception_ptr(
+						std::runtime_error("pipeline stage could not be scheduled, pool is too small")));
+				}
+				continue;
+			}
+			results.emplace_back(std::move(res));
+		}
+		// DISCARDĽ׶յbroken_promiseֹ׶ΣҪȫͷ״̬
+		for (auto& res : results) {
+			try {
+				res.get();
+			}
+			catch (...) {
+				state_->fail(std::current_exception());
+			}
+		}
+		if (state_->error_) {
+			std::rethrow_exception(state_->error_);
+		}
+	}
+
+private:
+	template<typename T, typename P>
+	friend class PipelineStage;
+
+	explicit Pipeline(std::shared_ptr<PipelineState<Pool>> state) :state_(std::move(state)) {}
+
+	std::shared_ptr<PipelineState<Pool>> state_;
+};
+
+// ڹˮߣTǵǰһ׶token
+template<typename T, typename Pool = ThreadPool>
+class PipelineStage {
+public:
+	// м׶ΣfnT&&һ׶εtoken
+	template<typename Fn>
+	auto then(StageMode mode, int concurrency, Fn fn) -> PipelineStage<std::decay_t<std::invoke_result_t<Fn&, T&&>>, Pool> {
+		using Out = std::decay_t<std::invoke_result_t<Fn&, T&&>>;
+		if (mode == StageMode::SERIAL || concurrency < 1) {
+			concurrency = 1;
+		}
+		auto out = std::make_shared<Channel<Out>>(state_->capacity_, concurrency);
+		std::shared_ptr<Sequencer> seq = makeSequencer(mode, concurrency);
+		addAborter(out, seq);
+
+		auto in = in_;
+		PipelineState<Pool>* state = state_.get();
+		for (int i = 0; i < concurrency; i++) {
+			state_->runners_.emplace_back([in, out, seq, state, fn]() mutable {
+				try {
+					T item;
+					size_t n;
+					while (in->pop(item, n)) {
+						Out res = fn(std::move(item));
+						if (seq == nullptr) {
+							if (!out->push(std::move(res))) {
+								break;
+							}
+							continue;
+						}
+						if (!seq->waitTurn(n)) {
+							break;
+						}
+						bool ok = out->push(std::move(res));
+						seq->advance();
+						if (!ok) {
+							break;
+						}
+					}
+				}
+				catch (...) {
+					state->fail(std::current_exception());
+				}
+				out->producerDone();
+				});
+		}
+		return PipelineStage<Out, Pool>(state_, out);
+	}
+
+	// յ׶ΣfnT&&û
+	template<typename Fn>
+	Pipeline<Pool> sink(StageMode mode, int concurrency, Fn fn) {
+		if (mode == StageMode::SERIAL || concurrency < 1) {
+			concurrency = 1;
+		}
+		std::shared_ptr<Sequencer> seq = makeSequencer(mode, concurrency);
+		if (seq != nullptr) {
+			std::unique_lock<std::mutex> lock(state_->mtx_);
+			state_->aborters_.emplace_back([seq]() { seq->abort(); });
+		}
+
+		auto in = in_;
+		PipelineState<Pool>* state = state_.get();
+		for (int i = 0; i < concurrency; i++) {
+			state_->runners_.emplace_back([in, seq, state, fn]() mutable {
+				try {
+					T item;
+					size_t n;
+					while (in->pop(item, n)) {
+						if (seq == nullptr) {
+							fn(std::move(item));
+							continue;
+						}
+						if (!seq->waitTurn(n)) {
+							break;
+						}
+						fn(std::move(item));
+						seq->advance();
+					}
+				}
+				catch (...) {
+					state->fail(std::current_exception());
+				}
+				});
+		}
+		return Pipeline<Pool>(state_);
+	}
+
+private:
+	friend class Pipeline<Pool>;
+	template<typename U, typename P>
+	friend class PipelineStage;
+
+	PipelineStage(std::shared_ptr<PipelineState<Pool>> state, std::shared_ptr<Channel<T>> in) :
+		state_(std::move(state)),
+		in_(std::move(in))
+	{}
+
+	// ֻж·ҪʱҪ
+	static std::shared_ptr<Sequencer> makeSequencer(StageMode mode, int concurrency) {
+		if (mode == StageMode::PARALLEL_ORDERED && concurrency > 1) {
+			return std::make_shared<Sequencer>();
+		}
+		return nullptr;
+	}
+
+	template<typename U>
+	void addAborter(std::shared_ptr<Channel<U>> ch, std::shared_ptr<Sequencer> seq) {
+		std::unique_lock<std::mutex> lock(state_->mtx_);
+		state_->aborters_.emplace_back([ch, seq]() {
+			ch->abort();
+			if (seq != nullptr) {
+				seq->abort();
+			}
+			});
+	}
+
+	std::shared_ptr<PipelineState<Pool>> state_;
+	std::shared_ptr<Channel<T>> in_;    // һ׶εͨ
+};
+
+template<typename Pool>
+template<typename T, typename Gen>
+PipelineStage<T, Pool> Pipeline<Pool>::source(Pool& pool, size_t capacity, Gen gen) {
+	auto sp = std::make_shared<PipelineState<Pool>>(pool, capacity);
+	auto out = std::make_shared<Channel<T>>(capacity, 1);
+	PipelineStage<T, Pool> stage(sp, out);
+	stage.addAborter(out, nullptr);
+
+	// ִָֻ룬run()һֱ״ֱִ̬
+	PipelineState<Pool>* state = sp.get();
+	state->runners_.emplace_back([out, state, gen]() mutable {
+		try {
+			for (;;) {
+				T item;
+				if (!gen(item) || !out->push(std::move(item))) {
+					break;
+				}
+			}
+		}
+		catch (...) {
+			state->fail(std::current_exception());
+		}
+		out->producerDone();
+		});
+	return stage;
+}
+
+
+#endif // !PIPELINE_H
@@ -0,0 +1,357 @@
+﻿// 线程池的压力测试，和演示程序分开编译，最好打开ThreadSanitizer：
+// g++ -O1 -g -std=c++17 -pthread -fsanitize=thread stress.cpp -o stress
+// ./stress [种子] [轮数]
+// 多个线程同时提交、关闭、等待空闲，线程池内部在容易出竞争的地方随机让出和睡眠，
+// 检查每个任务恰好执行一次、没有丢失的唤醒、内部计数互相一致
+// 提交方式混合了future、post、完成队列、微批处理和并行区域，DISCARD关闭时它们都不能卡住
+#ifndef THREADPOOL_STRESS
+#define THREADPOOL_STRESS
+#endif
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <future>
+#include <random>
+#include <memory>
+#include <cstdlib>
+#include <ctime>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include "threadpool.h"
+#include "completionqueue.h"
+#include "batcher.h"
+
+const int STRESS_SUBMITTER_SIZE = 4;
+const int STRESS_TASK_SIZE = 300;              // 每个提交线程每轮提交的任务数量
+const auto STRESS_WAIT_TIME = std::chrono::seconds(10);   // 超过这个时间还没完成就认为唤醒丢失了
+const int STRESS_REGION_SIZE = 20;             // 每轮最多执行的并行区域数量
+const int STRESS_REGION_WIDTH = 8;             // 并行区域最多的线程数
+
+// 一轮测试的配置，由种子随机决定
+struct StressConfig {
+    bool cached;          // cached模式，会反复扩容和回收线程
+    int threadSize;
+    int producerBuffer;   // 提交缓冲区大小，0表示不用
+    int spinWorkers;      // 自旋线程的数量
+    bool lazyStart;
+    int shutdownMode;     // 0: 提交完正常等待 1: 提交中途DRAIN关闭 2: 提交中途DISCARD关闭
+    bool idle;            // 提交完空闲一段时间，让cached模式回收线程
+};
+
+// 所有任务执行的次数，任务编号是下标
+struct StressState {
+    std::vector<std::atomic<int>> runs;
+    std::atomic_bool stop{ false };
+    std::atomic<uint64_t> failures{ 0 };
+
+    explicit StressState(size_t size) :runs(size) {
+        for (auto& r : runs) {
+            r.store(0);
+        }
+    }
+
+    void fail(const std::string& what) {
+        failures++;
+        std::cerr << " stress fail: " << what << std::endl;
+    }
+};
+
+// 任务的提交方式，被拒绝和被丢弃时的表现各不相同
+enum class StressKind {
+    FUTURE,   // submitTask：被拒绝返回默认值0，被丢弃收到broken_promise
+    POST,     // post：被拒绝返回false，接受了的任务被丢弃时什么也收不到
+    QUEUE,    // 完成队列：被拒绝或者被丢弃都收到broken_promise
+    BATCH     // 微批处理：同上
+};
+
+// 一个任务的结果，执行过的任务返回编号+1
+// post的结果是提交时的返回值，完成队列的结果由提交线程最后取出来转成future
+struct StressResult {
+    int id;
+    StressKind kind;
+    std::future<int> result;
+};
+
+template<typename Pool>
+using StressBatcher = Batcher<int, int, int, Pool>;
+
+// 一个提交线程：随机选提交方式和分组提交任务，任务记录自己执行了几次
+template<typename Pool>
+void submitter(Pool& pool, StressState& state, int index, uint64_t seed,
+    const std::vector<int>& groups, StressBatcher<Pool>& batcher, std::vector<StressResult>& results) {
+    std::mt19937_64 rng(seed + index);
+    int base = index * STRESS_TASK_SIZE;
+    // 完成队列只能有一个线程取结果，每个提交线程一个
+    CompletionQueue<int, Pool> cq(pool);
+    std::vector<int> queued;   // 完成队列的任务编号到压力测试任务编号
+    for (int i = 0; i < STRESS_TASK_SIZE; i++) {
+        int id = base + i;
+        int work = (int)(rng() % 4);
+        auto task = [&state, id, work]() -> int {
+            state.runs[id]++;
+            if (work == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            else if (work == 1) {
+                std::this_thread::yield();
+            }
+            return id + 1;
+        };
+        int how = (int)(rng() % 8);
+        if (how < 4) {
+            if (groups.empty() || how < 2) {
+                results.push_back({ id, StressKind::FUTURE, pool.submitTask(task) });
+            }
+            else {
+                results.push_back({ id, StressKind::FUTURE, pool.submitGroupTask(groups[rng() % groups.size()], task) });
+            }
+        }
+        else if (how < 6) {
+            std::promise<int> accepted;
+            accepted.set_value(pool.post(task) ? 1 : 0);
+            results.push_back({ id, StressKind::POST, accepted.get_future() });
+        }
+        else if (how == 6) {
+            size_t qid = cq.submit(task);
+            if (qid >= queued.size()) {
+                queued.resize(qid + 1, -1);
+            }
+            queued[qid] = id;
+        }
+        else {
+            results.push_back({ id, StressKind::BATCH, batcher.submit(0, id) });
+        }
+        // 线程池关闭之后停下，避免刷屏
+        if (state.stop.load()) {
+            return;
+        }
+        if (rng() % 32 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200));
+        }
+    }
+
+    // 每个提交给完成队列的任务都必须有一个结果，被丢弃的也一样，否则这里会一直等
+    typename CompletionQueue<int, Pool>::Completion c;
+    while (cq.pop(c)) {
+        std::promise<int> done;
+        try {
+            done.set_value(c.get());
+        }
+        catch (...) {
+            done.set_exception(std::current_exception());
+        }
+        results.push_back({ queued[c.id], StressKind::QUEUE, done.get_future() });
+    }
+}
+
+// 并行区域：每个线程各自记一次，中间用屏障同步几轮
+// 线程数取线程池承诺的上限，cached模式下比已有的线程多，要靠扩容才能凑齐
+// 关闭之后提交不了或者被丢弃的区域抛异常，不能卡住
+template<typename Pool>
+void runRegion(Pool& pool, StressState& state, bool shutdownMidRun) {
+    int n = std::min(pool.availableWorkerSize() + 1, STRESS_REGION_WIDTH);
+    if (n < 2) {
+        n = 2;
+    }
+    std::atomic<int> hits(0);
+    try {
+        bool ok = pool.parallelRegion(n, [&hits](int, SpinBarrier& barrier) {
+            for (int step = 0; step < 3; step++) {
+                barrier.wait();
+            }
+            hits++;
+            });
+        if (ok && hits.load() != n) {
+            state.fail("parallel region ran " + std::to_string(hits.load()) + " of " + std::to_string(n) + " workers");
+        }
+        if (!ok && !shutdownMidRun) {
+            state.fail("parallel region rejected");
+        }
+    }
+    catch (const std::exception&) {
+        if (!shutdownMidRun) {
+            state.fail("parallel region dropped without shutdown");
+        }
+    }
+}
+
+// 提交期间不停地执行并行区域
+template<typename Pool>
+void regioner(Pool& pool, StressState& state, const std::atomic_bool& done, bool shutdownMidRun) {
+    for (int i = 0; i < STRESS_REGION_SIZE && !done.load(); i++) {
+        runRegion(pool, state, shutdownMidRun);
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
+template<typename Pool>
+bool stressRound(uint64_t seed, int round) {
+    // ThreadPool有任务组和cached模式，FixedThreadPool都没有
+    constexpr bool full = std::is_same<Pool, ThreadPool>::value;
+    std::mt19937_64 rng(seed * 1000 + round);
+    StressConfig config;
+    config.cached = full && rng() % 2 == 0;
+    config.threadSize = 1 + (int)(rng() % 4);
+    // cached模式加提交缓冲区时扩容要靠缓冲区里的任务触发，每隔几轮固定覆盖一次
+    config.producerBuffer = rng() % 3 == 0 || (config.cached && round % 4 == 0) ? 4 : 0;
+    config.spinWorkers = config.threadSize > 1 && rng() % 3 == 0 ? 1 : 0;
+    config.lazyStart = rng() % 3 == 0;
+    config.shutdownMode = (int)(rng() % 3);
+    config.idle = config.cached && (rng() % 4 == 0 || round % 4 == 0);
+    PoolStress::setSeed(rng());
+
+    std::cout << "round " << round << ": " << (config.cached ? "cached" : "fixed")
+        << " threads=" << config.threadSize << " buffer=" << config.producerBuffer
+        << " spin=" << config.spinWorkers
+        << " lazy=" << config.lazyStart << " shutdown=" << config.shutdownMode
+        << " idle=" << config.idle << std::endl;
+
+    StressState state(STRESS_SUBMITTER_SIZE * STRESS_TASK_SIZE);
+    auto pool = std::make_unique<Pool>();
+    if (config.cached) {
+        pool->setMode(PoolMode::MODE_CACHED);
+        pool->setThreadSizeThreadHold(config.threadSize + 4);
+    }
+    pool->setTaskQueMaxThreadHold(64);
+    pool->setProducerBufferSize(config.producerBuffer);
+    pool->setSpinWorkerSize(config.spinWorkers);
+    pool->setLazyStart(config.lazyStart);
+    std::vector<int> groups;
+    if constexpr (full) {
+        groups.push_back(pool->createTaskGroup(1, 1));
+        groups.push_back(pool->createTaskGroup(3, 0, 8));
+    }
+    pool->start(config.threadSize);
+
+    // 同一个key的任务攒成一批执行，结果是编号+1
+    auto batcher = std::make_unique<StressBatcher<Pool>>(*pool, 8, std::chrono::microseconds(100),
+        [&state](const int&, int* ids, int* out, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                state.runs[ids[i]]++;
+                out[i] = ids[i] + 1;
+            }
+        });
+
+    // 检查线程一直检查计数
+    std::atomic_bool checking(true);
+    std::thread checker([&]() {
+        while (checking.load()) {
+            if (!pool->checkInvariants()) {
+                state.fail("invariant");
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        });
+
+    std::vector<std::vector<StressResult>> results(STRESS_SUBMITTER_SIZE);
+    std::vector<std::thread> submitters;
+    for (int i = 0; i < STRESS_SUBMITTER_SIZE; i++) {
+        submitters.emplace_back(submitter<Pool>, std::ref(*pool), std::ref(state), i, rng(),
+            std::cref(groups), std::ref(*batcher), std::ref(results[i]));
+    }
+    std::atomic_bool submitted(false);
+    std::thread regions(regioner<Pool>, std::ref(*pool), std::ref(state), std::cref(submitted),
+        config.shutdownMode != 0);
+
+    // 提交中途关闭
+    if (config.shutdownMode != 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 20000));
+        state.stop = true;
+        ShutdownMode mode = config.shutdownMode == 1 ? ShutdownMode::DRAIN : ShutdownMode::DISCARD;
+        if (!pool->shutdown(mode, STRESS_WAIT_TIME)) {
+            state.fail("shutdown timeout");
+        }
+    }
+    for (auto& t : submitters) {
+        t.join();
+    }
+    submitted = true;
+    regions.join();
+    // 析构时提交没攒满的批次并等它们结束，被丢弃的批次不能让它一直等
+    batcher.reset();
+
+    if (config.shutdownMode == 0) {
+        if (!pool->awaitIdle(STRESS_WAIT_TIME)) {
+            state.fail("awaitIdle timeout, lost wakeup");
+        }
+        if (config.idle) {
+            // 超过THREAD_MAX_IDLE_TIME的线程被回收，之后再提交一批让线程重新扩容
+            std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+            // 只剩最初的线程时执行并行区域，不够的线程要在提交时扩容出来
+            runRegion(*pool, state, false);
+            std::future<int> again = pool->submitTask([]() { return 1; });
+            if (again.wait_for(STRESS_WAIT_TIME) != std::future_status::ready) {
+                state.fail("task after reaping lost");
+            }
+        }
+    }
+    // 关闭之后所有线程都已经退出，计数必须归零
+    if (!pool->shutdown(ShutdownMode::DRAIN, STRESS_WAIT_TIME)) {
+        state.fail("shutdown timeout");
+    }
+    checking = false;
+    checker.join();
+    if (!pool->checkInvariants()) {
+        state.fail("invariant after shutdown");
+    }
+
+    // 每个future都必须有结果：执行过的任务恰好执行一次，被拒绝或者丢弃的任务一次都没执行
+    for (auto& list : results) {
+        for (auto& [id, kind, result] : list) {
+            if (result.wait_for(STRESS_WAIT_TIME) != std::future_status::ready) {
+                state.fail("task " + std::to_string(id) + " future never ready");
+                continue;
+            }
+            int expect = 0;
+            try {
+                int value = result.get();
+                if (kind == StressKind::POST) {
+                    // 接受了的任务只有DISCARD关闭才可能没执行
+                    if (value == 1 && config.shutdownMode == 2 && state.runs[id].load() == 0) {
+                        continue;
+                    }
+                    expect = value;
+                }
+                else {
+                    expect = value == id + 1 ? 1 : 0;
+                }
+            }
+            catch (const std::future_error&) {
+                // 完成队列和微批处理在关闭之后提交失败也收到broken_promise
+                bool rejected = kind != StressKind::FUTURE && config.shutdownMode != 0;
+                if (config.shutdownMode != 2 && !rejected) {
+                    state.fail("task " + std::to_string(id) + " discarded without DISCARD shutdown");
+                }
+            }
+            if (state.runs[id].load() != expect) {
+                state.fail("task " + std::to_string(id) + " ran " + std::to_string(state.runs[id].load()) +
+                    " times, expect " + std::to_string(expect));
+            }
+        }
+    }
+    return state.failures.load() == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : (uint64_t)time(nullptr);
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+    std::cout << "seed " << seed << std::endl;
+
+    int failed = 0;
+    for (int i = 0; i < rounds; i++) {
+        if (!stressRound<ThreadPool>(seed, i * 2)) {
+            failed++;
+        }
+        if (!stressRound<FixedThreadPool>(seed, i * 2 + 1)) {
+            failed++;
+        }
+    }
+    std::cout << (failed == 0 ? "all rounds passed" : "some rounds failed, rerun with the same seed") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
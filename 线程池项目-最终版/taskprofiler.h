@@ -0,0 +1,288 @@
+#ifndef TASKPROFILER_H
+#define TASKPROFILER_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include "threadpool.h"
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/*
+* example:
+* ProfiledThreadPool pool;
+* TaskProfiler& profiler = pool.getMetrics().profiler();
+* profiler.setSampleRate(16);
+* profiler.setSlowThreshold(std::chrono::milliseconds(5));
+* pool.start(4);
+* pool.submitTaggedTask("parse", parse, buf);
+* ...
+* for (auto& s : profiler.snapshot()) {
+*	std::cout << s.tag << " " << s.sampled << " " << s.wallNs / s.sampled << "ns" << std::endl;
+* }
+*/
+
+const int PROFILER_MAX_TAGS = 256;       // ÿ̵߳ͳƵıǩĹ鵽"<other>"
+const int PROFILER_SLOW_RECORDS = 128;   // ¼
+const int PROFILER_SAMPLE_RATE = 64;     // Ĭÿ߳ÿ64һ
+
+// һǩĻܣֻͳƱ
+struct TaskProfileStats {
+	std::string tag;
+	uint64_t sampled;     // 
+	uint64_t wallNs;      // ǽʱ֮
+	uint64_t cpuNs;       // ߳cpuʱ֮
+	uint64_t maxWallNs;   // һǽʱ
+};
+
+// һγֵ
+struct SlowTaskRecord {
+	std::string tag;
+	int worker;           // ִĹ߳±
+	uint64_t wallNs;
+	uint64_t cpuNs;       // ûûжcpuʱ䣬Ϊ0
+	std::chrono::system_clock::time_point finishTime;
+};
+
+// ǩͳǽʱ߳cpuʱ䣬¼ֵ
+// ÿֻ߳дԼͳƱֻ¼Ҫ
+// ûֻһμݼֵʱٶsteady_clock
+class TaskProfiler {
+public:
+	TaskProfiler() :sampleRate_(PROFILER_SAMPLE_RATE), slowThresholdNs_(UINT64_MAX) {
+		for (int i = 0; i < THREAD_MAX_THREADHOLD; i++) {
+			workers_[i].store(nullptr);
+		}
+	}
+
+	~TaskProfiler() {
+		for (int i = 0; i < THREAD_MAX_THREADHOLD; i++) {
+			delete workers_[i].load();
+		}
+	}
+
+	TaskProfiler(const TaskProfiler&) = delete;
+	TaskProfiler& operator=(const TaskProfiler&) = delete;
+
+	// ÿ߳ÿrateһ1ʾȫ0ʾر
+	void setSampleRate(int rate) {
+		sampleRate_.store(rate < 0 ? 0 : rate, std::memory_order_relaxed);
+	}
+
+	// ǽʱ䳬thresholdΪ񣬲ûб
+	void setSlowThreshold(std::chrono::nanoseconds threshold) {
+		slowThresholdNs_.store((uint64_t)threshold.count(), std::memory_order_relaxed);
+	}
+
+	// ʼʱµʱ䣬ǽʱ飬cpuʱֻڲʱ
+	struct Probe {
+		bool sampled;
+		bool timed;          // Ƿǽʱ
+		uint64_t wallStart;
+		uint64_t cpuStart;
+	};
+
+	// ʼִ
+	Probe begin(int worker) {
+		Probe probe{ false, false, 0, 0 };
+		if (worker < 0 || worker >= THREAD_MAX_THREADHOLD) {
+			return probe;
+		}
+		int rate = sampleRate_.load(std::memory_order_relaxed);
+		if (rate != 0) {
+			WorkerProfile& wp = workerProfile(worker);
+			if (--wp.countdown <= 0) {
+				wp.countdown = rate;
+				probe.sampled = true;
+				probe.cpuStart = threadCpuNs();
+			}
+		}
+		// ܳκһϣֵÿ񶼼ʱ
+		if (probe.sampled || slowThresholdNs_.load(std::memory_order_relaxed) != UINT64_MAX) {
+			probe.timed = true;
+			probe.wallStart = wallNs();
+		}
+		return probe;
+	}
+
+	// ִ꣬ۼӵ̵߳ͳƱֵļΪ
+	void end(const Probe& probe, const char* tag, int worker) {
+		if (!probe.timed) {
+			return;
+		}
+		uint64_t wall = wallNs() - probe.wallStart;
+		uint64_t cpu = probe.sampled ? threadCpuNs() - probe.cpuStart : 0;
+		if (probe.sampled) {
+			record(workerProfile(worker).find(tag), wall, cpu);
+		}
+		if (wall >= slowThresholdNs_.load(std::memory_order_relaxed)) {
+			std::unique_lock<std::mutex> lock(slowMtx_);
+			if (slowTasks_.size() >= PROFILER_SLOW_RECORDS) {
+				slowTasks_.pop_front();
+			}
+			slowTasks_.push_back({ tag, worker, wall, cpu, std::chrono::system_clock::now() });
+		}
+	}
+
+	// ϲй̵߳ͳƣ̳߳ʱãǽƵĿ
+	// ͬ뵥Ԫܲͬһָ룬ַϲ
+	std::vector<TaskProfileStats> snapshot() const {
+		std::vector<TaskProfileStats> result;
+		for (int i = 0; i < THREAD_MAX_THREADHOLD; i++) {
+			WorkerProfile* wp = workers_[i].load(std::memory_order_acquire);
+			if (wp == nullptr) {
+				continue;
+			}
+			for (int k = 0; k <= PROFILER_MAX_TAGS; k++) {
+				const Entry& entry = wp->entries[k];
+				const char* tag = entry.tag.load(std::memory_order_acquire);
+				if (tag == nullptr) {
+					continue;
+				}
+				TaskProfileStats* stats = nullptr;
+				for (auto& s : result) {
+					if (s.tag == tag) {
+						stats = &s;
+						break;
+					}
+				}
+				if (stats == nullptr) {
+					result.push_back({ tag, 0, 0, 0, 0 });
+					stats = &result.back();
+				}
+				stats->sampled += entry.sampled.load(std::memory_order_relaxed);
+				stats->wallNs += entry.wallNs.load(std::memory_order_relaxed);
+				stats->cpuNs += entry.cpuNs.load(std::memory_order_relaxed);
+				uint64_t maxWall = entry.maxWallNs.load(std::memory_order_relaxed);
+				if (maxWall > stats->maxWallNs) {
+					stats->maxWallNs = maxWall;
+				}
+			}
+		}
+		return result;
+	}
+
+	// 񣬰Ⱥ˳
+	std::vector<SlowTaskRecord> slowTasks() const {
+		std::unique_lock<std::mutex> lock(slowMtx_);
+		return std::vector<SlowTaskRecord>(slowTasks_.begin(), slowTasks_.end());
+	}
+
+private:
+	// һǩļֻĹ߳д
+	struct Entry {
+		std::atomic<const char*> tag{ nullptr };
+		std::atomic<uint64_t> sampled{ 0 };
+		std::atomic<uint64_t> wallNs{ 0 };
+		std::atomic<uint64_t> cpuNs{ 0 };
+		std::atomic<uint64_t> maxWallNs{ 0 };
+	};
+
+	// һ̵߳ͳƱǩָ뿪ѰַһŲµıǩ
+	struct alignas(CACHE_LINE_SIZE) WorkerProfile {
+		int countdown = 1;     // 0ʱ
+		Entry entries[PROFILER_MAX_TAGS + 1];
+
+		Entry& find(const char* tag) {
+			size_t h = (size_t)(uintptr_t)tag;
+			h = (h >> 4) ^ (h >> 12);
+			for (int i = 0; i < PROFILER_MAX_TAGS; i++) {
+				Entry& entry = entries[(h + i) % PROFILER_MAX_TAGS];
+				const char* cur = entry.tag.load(std::memory_order_relaxed);
+				if (cur == tag) {
+					return entry;
+				}
+				if (cur == nullptr) {
+					entry.tag.store(tag, std::memory_order_release);
+					return entry;
+				}
+			}
+			Entry& other = entries[PROFILER_MAX_TAGS];
+			if (other.tag.load(std::memory_order_relaxed) == nullptr) {
+				other.tag.store("<other>", std::memory_order_release);
+			}
+			return other;
+		}
+	};
+
+	// ۼһβֻб߳ддֿ͹ˣҪԭӵļӷ
+	static void record(Entry& entry, uint64_t wall, uint64_t cpu) {
+		entry.sampled.store(entry.sampled.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		entry.wallNs.store(entry.wallNs.load(std::memory_order_relaxed) + wall, std::memory_order_relaxed);
+		entry.cpuNs.store(entry.cpuNs.load(std::memory_order_relaxed) + cpu, std::memory_order_relaxed);
+		if (wall > entry.maxWallNs.load(std::memory_order_relaxed)) {
+			entry.maxWallNs.store(wall, std::memory_order_relaxed);
+		}
+	}
+
+	// ̵߳һβʱԼͳƱcachedģʽòλ߳̽
+	WorkerProfile& workerProfile(int worker) {
+		WorkerProfile* wp = workers_[worker].load(std::memory_order_relaxed);
+		if (wp == nullptr) {
+			wp = new WorkerProfile();
+			workers_[worker].store(wp, std::memory_order_release);
+		}
+		return *wp;
+	}
+
+	static uint64_t wallNs() {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// ǰ߳ĵcpuʱ
+	static uint64_t threadCpuNs() {
+#if defined(_WIN32)
+		FILETIME createTime, exitTime, kernel, user;
+		GetThreadTimes(GetCurrentThread(), &createTime, &exitTime, &kernel, &user);
+		uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+		uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+		return (k + u) * 100;   // λ100ns
+#else
+		timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+	}
+
+private:
+	std::atomic_int sampleRate_;
+	std::atomic<uint64_t> slowThresholdNs_;
+	std::atomic<WorkerProfile*> workers_[THREAD_MAX_THREADHOLD];   // ߳±
+
+	mutable std::mutex slowMtx_;
+	std::deque<SlowTaskRecord> slowTasks_;
+};
+
+// ͳƵĻϼ
+class ProfiledMetrics :public GroupMetrics {
+public:
+	using Probe = TaskProfiler::Probe;
+
+	Probe beginTask(int worker) {
+		return profiler_.begin(worker);
+	}
+	void endTask(const Probe& probe, const PoolTask& task, int worker) {
+		profiler_.end(probe, task.tag(), worker);
+	}
+
+	TaskProfiler& profiler() {
+		return profiler_;
+	}
+
+private:
+	TaskProfiler profiler_;
+};
+
+// ̳߳
+using ProfiledThreadPool = BasicThreadPool<FairShareQueue, BlockingWait, DynamicSizing, ProfiledMetrics>;
+
+
+#endif // !TASKPROFILER_H
@@ -8,15 +8,85 @@
 #include <mutex>
 #include <condition_variable>    // 
 #include <functional>
-#include <unordered_map>
 #include <thread>
 #include <future>
+#include <exception>
+#include <stdexcept>
+#include <chrono>
 #include <iostream>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <string>
+#include "arena.h"
+#include "tracer.h"
+#include "barrier.h"
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
 
 
 const int TASK_MAX_THREADHOLD = 2; //  INT32_MAX;
 const int THREAD_MAX_THREADHOLD = 1024;
+#ifdef THREADPOOL_STRESS
+const int THREAD_MAX_IDLE_TIME = 1;    // ѹʱcachedģʽ߳̾챻
+#else
 const int THREAD_MAX_IDLE_TIME = 60;   //λs
+#endif
+const int TASK_MAX_GROUPS = 64;        // 
+const int SPIN_MAX_COUNT = 2000;       // ȴĴ
+const int PRODUCER_MAX_SIZE = 64;      // ʹύⲿ߳
+const size_t CACHE_LINE_SIZE = 64;     // дС̸߳дݰα
+
+// ־THREADPOOL_DEBUGӡ̻߳ȡ񡢴ͻյĹ
+#ifdef THREADPOOL_DEBUG
+#define POOL_LOG(msg) (std::cout << msg << std::endl)
+#else
+#define POOL_LOG(msg) ((void)0)
+#endif
+
+// ѹԣTHREADPOOL_STRESS׳ĵطó˯ߣ̵ִ߳˳
+// ÿ̵߳Ӻ̵߳һξŶȺͬһӿԸͬŶ
+#ifdef THREADPOOL_STRESS
+class PoolStress {
+public:
+	static void setSeed(uint64_t seed) {
+		seed_().store(seed);
+	}
+
+	static void point() {
+		uint64_t& x = state();
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		switch (x % 16) {
+		case 0:
+		case 1:
+			std::this_thread::yield();
+			break;
+		case 2:
+			std::this_thread::sleep_for(std::chrono::microseconds(x % 100));
+			break;
+		default:
+			break;
+		}
+	}
+
+private:
+	static std::atomic<uint64_t>& seed_() {
+		static std::atomic<uint64_t> seed(1);
+		return seed;
+	}
+	static uint64_t& state() {
+		static std::atomic<uint64_t> order(0);
+		thread_local uint64_t x = (seed_().load() ^ (++order * 0x9E3779B97F4A7C15ull)) | 1;
+		return x;
+	}
+};
+#define POOL_STRESS_POINT() PoolStress::point()
+#else
+#define POOL_STRESS_POINT() ((void)0)
+#endif
 
 // classöֲһһ
 // ֵ̳֧߳ģʽ
@@ -25,22 +95,77 @@ enum class PoolMode {
 	MODE_CACHED	// ߳ɶ̬
 };
 
+// ̳߳عرյķʽ
+enum class ShutdownMode {
+	DRAIN,      // Ŷӵȫִ˳
+	DISCARD     // Ŷӵִֻе
+};
+
+
+// ͳϢ
+struct TaskGroupStats {
+	size_t submitted;   // ɹύ
+	size_t rejected;    // ܾ
+	size_t completed;   // ִɵ
+	size_t queued;      // Ŷӵ
+	int running;        // ִе
+};
+
 
 // ߳
+// Windowsƽֱ̨pthreadָջСҳСϵͳ￴߳
 class Thread {
 public:
 	// ̺߳
 	using ThreadFunc = std::function<void(int)>;
 
-	// ̹߳
-	Thread(ThreadFunc func) :func_(func), threadId_(generateId_++) {}
+	// ̹߳죬stackSizeguardSizeΪ0ʾϵͳĬֵnameΪղ߳
+	Thread(ThreadFunc func, std::string name = "", size_t stackSize = 0, size_t guardSize = 0) :
+		func_(func),
+		threadId_(generateId_++),
+		name_(std::move(name)),
+		stackSize_(stackSize),
+		guardSize_(guardSize),
+		started_(false)
+	{}
 	// ߳
 	~Thread() = default;
-	// ߳
-	void start() {
-		// һִ߳һ̺߳
-		std::thread t(func_, threadId_);			// ̶߳t̺߳func_
-		t.detach();		 // ÷뺯
+	// ̣߳ʧܷfalse
+	bool start() {
+#if defined(_WIN32)
+		// һִ߳һ̺̳߳߳߳ظjoin
+		thread_ = std::thread(func_, threadId_);
+#else
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		if (stackSize_ > 0 && pthread_attr_setstacksize(&attr, stackSize_) != 0) {
+			std::cerr << " thread stack size " << stackSize_ << " invalid,use default." << std::endl;
+		}
+		if (guardSize_ > 0 && pthread_attr_setguardsize(&attr, guardSize_) != 0) {
+			std::cerr << " thread guard size " << guardSize_ << " invalid,use default." << std::endl;
+		}
+		int err = pthread_create(&handle_, &attr, &Thread::entry, this);
+		pthread_attr_destroy(&attr);
+		if (err != 0) {
+			std::cerr << " create thread fail,error " << err << "." << std::endl;
+			return false;
+		}
+#endif
+		started_ = true;
+		return true;
+	}
+
+	// ȴ߳̽
+	void join() {
+		if (!started_) {
+			return;
+		}
+#if defined(_WIN32)
+		thread_.join();
+#else
+		pthread_join(handle_, nullptr);
+#endif
+		started_ = false;
 	}
 
 	// ȡ߳id
@@ -48,51 +173,591 @@ public:
 		return threadId_;
 	}
 private:
+#if !defined(_WIN32)
+	static void* entry(void* arg) {
+		Thread* self = static_cast<Thread*>(arg);
+		if (!self->name_.empty()) {
+			// linux߳15ַ
+			std::string name = self->name_.substr(0, 15);
+#if defined(__APPLE__)
+			pthread_setname_np(name.c_str());
+#else
+			pthread_setname_np(pthread_self(), name.c_str());
+#endif
+		}
+		self->func_(self->threadId_);
+		return nullptr;
+	}
+#endif
+
 	ThreadFunc func_;   // 
-	static int generateId_;
+	static std::atomic_int generateId_;
 	int threadId_;	    // ߳id
+	std::string name_;  // ϵͳ￴߳
+	size_t stackSize_;
+	size_t guardSize_;
+	bool started_;
+#if defined(_WIN32)
+	std::thread thread_;
+#else
+	pthread_t handle_;
+#endif
+};
+
+
+std::atomic_int Thread::generateId_(0);
+
+
+// ǰ߳ĸ̳߳صĸλ̳߳ص߳indexΪ-1
+struct WorkerIdentity {
+	const void* pool = nullptr;
+	int index = -1;
+
+	static WorkerIdentity& current() {
+		thread_local WorkerIdentity identity;
+		return identity;
+	}
+};
+
+
+// ֱTask* ɾֲָ,ûTaskڿܷǳĶ
+// Task == ֻƶύ̵߳TaskArena
+class PoolTask {
+public:
+	PoolTask() :node_(nullptr) {}
+
+	// ԽɵötagıǩΪʱÿɵö
+	template<typename Func, typename = std::enable_if_t<!std::is_same<std::decay_t<Func>, PoolTask>::value>>
+	PoolTask(Func&& func, const char* tag = nullptr) :node_(nullptr) {
+		using Node = FuncNode<std::decay_t<Func>>;
+		if (alignof(Node) > alignof(std::max_align_t)) {
+			node_ = new Node(std::forward<Func>(func), false);
+		}
+		else {
+			node_ = new (TaskArena::allocate(sizeof(Node))) Node(std::forward<Func>(func), true);
+		}
+		node_->tag = tag != nullptr ? tag : typeid(std::decay_t<Func>).name();
+	}
+
+	~PoolTask() {
+		reset();
+	}
+
+	PoolTask(PoolTask&& other) noexcept :node_(other.node_) {
+		other.node_ = nullptr;
+	}
+	PoolTask& operator=(PoolTask&& other) noexcept {
+		if (this != &other) {
+			reset();
+			node_ = other.node_;
+			other.node_ = nullptr;
+		}
+		return *this;
+	}
+	PoolTask(const PoolTask&) = delete;
+	PoolTask& operator=(const PoolTask&) = delete;
+
+	// ִ
+	void operator()() {
+		node_->run();
+	}
+
+	explicit operator bool() const {
+		return node_ != nullptr;
+	}
+
+	// ʱϵıţĵַ
+	uint64_t traceId() const {
+		return (uint64_t)(uintptr_t)node_;
+	}
+
+	// ıǩ
+	const char* tag() const {
+		return node_ != nullptr ? node_->tag : nullptr;
+	}
+
+	// ͷûִйpromiseյbroken_promise
+	void reset() {
+		if (node_ != nullptr) {
+			node_->destroy();
+			node_ = nullptr;
+		}
+	}
+
+private:
+	struct Node {
+		virtual void run() = 0;
+		virtual void destroy() = 0;
+
+		const char* tag = nullptr;
+	protected:
+		~Node() = default;
+	};
+
+	template<typename Func>
+	struct FuncNode final :Node {
+		FuncNode(Func&& f, bool inArena) :func(std::move(f)), inArena(inArena) {}
+		FuncNode(const Func& f, bool inArena) :func(f), inArena(inArena) {}
+
+		void run() override {
+			func();
+		}
+		void destroy() override {
+			if (!inArena) {
+				delete this;
+				return;
+			}
+			this->~FuncNode();
+			TaskArena::deallocate(this);
+		}
+
+		Func func;
+		bool inArena;     // ǷTaskArena
+	};
+
+	Node* node_;
+};
+
+
+// ĿɵöûִоͱͷʱonDrop
+// ύʧܣDISCARDرն˻Ŷӵ
+// ʼִʱdismiss()ֻƶƶ֮ԭĶЧ
+template<typename OnDrop>
+class TaskDropGuard {
+public:
+	explicit TaskDropGuard(OnDrop onDrop) :onDrop_(std::move(onDrop)), armed_(true) {}
+
+	TaskDropGuard(TaskDropGuard&& other) noexcept :onDrop_(std::move(other.onDrop_)), armed_(other.armed_) {
+		other.armed_ = false;
+	}
+	TaskDropGuard& operator=(TaskDropGuard&&) = delete;
+	TaskDropGuard(const TaskDropGuard&) = delete;
+	TaskDropGuard& operator=(const TaskDropGuard&) = delete;
+
+	~TaskDropGuard() {
+		if (armed_) {
+			onDrop_();
+		}
+	}
+
+	void dismiss() {
+		armed_ = false;
+	}
+
+private:
+	OnDrop onDrop_;
+	bool armed_;
+};
+
+
+/////////////////////  в  /////////////////////
+// нӿڶڳ̳߳taskQueMtx_ʱãrelease
+// popsourceĬһԴύṩhasTasks()pop(task)ĬĶһ
+
+// ȽȳУû
+class FifoQueue {
+public:
+	static constexpr bool groups = false;
+
+	bool hasGroup(int group) const {
+		return group == 0;
+	}
+	bool full(int, size_t limit) const {
+		return que_.size() >= limit;
+	}
+	void push(int, PoolTask&& task) {
+		que_.emplace(std::move(task));
+	}
+	template<typename Source>
+	bool pop(PoolTask& task, int& group, Source& source) {
+		group = 0;
+		if (que_.empty()) {
+			return source.pop(task);
+		}
+		task = std::move(que_.front());
+		que_.pop();
+		return true;
+	}
+	bool release(int) {
+		return false;
+	}
+	bool hasQueued(int) const {
+		return !que_.empty();
+	}
+	size_t queued(int) const {
+		return que_.size();
+	}
+	size_t size() const {
+		return que_.size();
+	}
+	void clear() {
+		std::queue<PoolTask>().swap(que_);
+	}
+
+private:
+	std::queue<PoolTask> que_;
+};
+
+// ƽȶУÿԼСȨغͲ
+// ̰߳deficit round robin֮תȡ0Ĭ
+class FairShareQueue {
+public:
+	static constexpr bool groups = true;
+
+	FairShareQueue() :groupSize_(0), curGroup_(0) {
+		createGroup(1, 0, 0);
+	}
+
+	// Ĳλ̶±idҲ԰id
+	int createGroup(int weight, int maxConcurrency, int queMaxThreadHold) {
+		int id = groupSize_.load();
+		if (id >= TASK_MAX_GROUPS) {
+			return -1;
+		}
+		groups_[id] = std::make_unique<Group>(weight < 1 ? 1 : weight, maxConcurrency, queMaxThreadHold);
+		groupSize_.store(id + 1);
+		return id;
+	}
+	bool hasGroup(int group) const {
+		return group >= 0 && group < groupSize_.load();
+	}
+	bool full(int group, size_t limit) const {
+		const Group& g = *groups_[group];
+		if (g.queMaxThreadHold > 0) {
+			limit = g.queMaxThreadHold;
+		}
+		return g.que.size() >= limit;
+	}
+	void push(int group, PoolTask&& task) {
+		groups_[group]->que.emplace(std::move(task));
+	}
+
+	// ÿ񰴵λ㣬ÿָ鲹weightĶ
+	// ĬĶĶкsourceãȡ
+	template<typename Source>
+	bool pop(PoolTask& task, int& group, Source& source) {
+		int n = groupSize_.load();
+		for (int scanned = 0; scanned <= n; scanned++) {
+			Group* g = groups_[curGroup_].get();
+			if (g->deficit > 0 && dispatchable(curGroup_, source)) {
+				if (!g->que.empty()) {
+					task = std::move(g->que.front());
+					g->que.pop();
+				}
+				else if (!source.pop(task)) {
+					return false;
+				}
+				g->deficit--;
+				g->running++;
+				group = curGroup_;
+				return true;
+			}
+			// ʱܵȣֵһ鲢
+			curGroup_ = (curGroup_ + 1) % n;
+			Group* next = groups_[curGroup_].get();
+			next->deficit = dispatchable(curGroup_, source) ? next->weight : 0;
+		}
+		return false;
+	}
+
+	// ִ꣬Ҫ
+	// trueʾв޵ڳҪhasQueued߳
+	bool release(int group) {
+		Group* g = groups_[group].get();
+		return --g->running < g->maxConcurrency;
+	}
+	bool hasQueued(int group) const {
+		return !groups_[group]->que.empty();
+	}
+	size_t queued(int group) const {
+		return groups_[group]->que.size();
+	}
+	int running(int group) const {
+		return groups_[group]->running;
+	}
+	size_t size() const {
+		size_t n = 0;
+		for (int i = 0; i < groupSize_.load(); i++) {
+			n += groups_[i]->que.size();
+		}
+		return n;
+	}
+	void clear() {
+		for (int i = 0; i < groupSize_.load(); i++) {
+			std::queue<PoolTask>().swap(groups_[i]->que);
+		}
+	}
+
+private:
+	struct Group {
+		Group(int w, int maxCon, int queMax) :
+			weight(w), maxConcurrency(maxCon), queMaxThreadHold(queMax), deficit(0), running(0) {}
+
+		std::queue<PoolTask> que;     // 
+		int weight;                   // Ȩ
+		int maxConcurrency;           // ޣ0ʾ
+		int queMaxThreadHold;         // ޵ֵ0ʾ̳߳ص
+		int deficit;                  // ʣĵȶ
+		std::atomic_int running;      // ִе
+	};
+
+	// ŶӣûдﵽޣĬ񻹿source
+	template<typename Source>
+	bool dispatchable(int id, Source& source) const {
+		const Group& g = *groups_[id];
+		if (g.que.empty() && (id != 0 || !source.hasTasks())) {
+			return false;
+		}
+		return g.maxConcurrency <= 0 || g.running < g.maxConcurrency;
+	}
+
+	std::unique_ptr<Group> groups_[TASK_MAX_GROUPS];
+	std::atomic_int groupSize_;       // Ѵ
+	int curGroup_;                    // תȵǰڵ
+};
+
+
+/////////////////////  ȴ  /////////////////////
+
+// ûֱ˯
+struct BlockingWait {
+	template<typename Pred>
+	static void spin(Pred) {}
+};
+
+// ˯֮ǰһᣬܼʱʡһں˻
+struct SpinWait {
+	template<typename Pred>
+	static void spin(Pred ready) {
+		for (int i = 0; i < SPIN_MAX_COUNT && !ready(); i++) {
+			cpuRelax();
+		}
+	}
+};
+
+
+/////////////////////  ߳  /////////////////////
+
+// ֻ֧fixedģʽûп̵߳ͳƺͳʱ
+struct FixedSizing {
+	static constexpr bool dynamic = false;
 };
 
+// ʱͨsetModeѡfixedcachedģʽ
+struct DynamicSizing {
+	static constexpr bool dynamic = true;
+};
+
+
+/////////////////////  ͳƲ  /////////////////////
+
+// κͳ
+class NoMetrics {
+public:
+	static constexpr bool enabled = false;
+
+	void onSubmit(int) {}
+	void onReject(int) {}
+	void onComplete(int) {}
+	void fill(int, TaskGroupStats&) const {}
+
+	// ִǰĻصworkerǹ̵߳±
+	struct Probe {};
+	Probe beginTask(int) { return Probe(); }
+	void endTask(const Probe&, const PoolTask&, int) {}
+};
+
+// ͳύܾɵ
+class GroupMetrics {
+public:
+	static constexpr bool enabled = true;
+
+	void onSubmit(int group) {
+		counters_[group].submitted.fetch_add(1, std::memory_order_relaxed);
+	}
+	void onReject(int group) {
+		counters_[group].rejected.fetch_add(1, std::memory_order_relaxed);
+	}
+	void onComplete(int group) {
+		counters_[group].completed.fetch_add(1, std::memory_order_relaxed);
+	}
+	void fill(int group, TaskGroupStats& stats) const {
+		stats.submitted = counters_[group].submitted.load(std::memory_order_relaxed);
+		stats.rejected = counters_[group].rejected.load(std::memory_order_relaxed);
+		stats.completed = counters_[group].completed.load(std::memory_order_relaxed);
+	}
+
+	struct Probe {};
+	Probe beginTask(int) { return Probe(); }
+	void endTask(const Probe&, const PoolTask&, int) {}
+
+private:
+	// ж룬ͬļ
+	struct alignas(64) Counters {
+		std::atomic<size_t> submitted{ 0 };
+		std::atomic<size_t> rejected{ 0 };
+		std::atomic<size_t> completed{ 0 };
+	};
+	Counters counters_[TASK_MAX_GROUPS];
+};
 
-int Thread::generateId_ = 0;
 
 /*
 * example:
 * ThreadPool pool;
 * pool.start(4);
-* class Mytask:public Task{
-*	public:
-*		void run() {̴߳};
-* }
-* pool.submitTask(std::make_shared<MyTask>());
+* std::future<int> res = pool.submitTask([](int a, int b) { return a + b; }, 10, 20);
+* std::cout << res.get() << std::endl;
 *
+* ҪcachedģʽͳƵĳϣ
+* FixedThreadPool pool;
 */
 // ̳߳
-class ThreadPool {
+// QueuePolicy  WaitPolicyûʱôȴ
+// SizingPolicyܷ̬߳  MetricsPolicyͳϢ
+template<typename QueuePolicy, typename WaitPolicy, typename SizingPolicy, typename MetricsPolicy>
+class BasicThreadPool {
 public:
 
 	// ̳߳ع
 	// 캯
-	ThreadPool() :
+	BasicThreadPool() :
+		slotCapacity_(0),
+		threadStackSize_(0),
+		threadGuardSize_(0),
+		threadNamePrefix_("pool"),
+		lazyStart_(false),
+		spinSize_(0),
+		handoffSize_(0),
 		initThreadSize_(0),
+		threadSizeThreadHold_(THREAD_MAX_THREADHOLD),
+		curThreadSize_(0),
+		idleThreadSize_(0),
 		taskSize_(0),
 		taskQueMaxThreadHold_(TASK_MAX_THREADHOLD),
+		producerBufferSize_(0),
+		producerSize_(0),
+		producerCursor_(0),
+		poolId_(nextPoolId()),
+		activeTaskSize_(0),
+		isShutdown_(false),
 		poolMode_(PoolMode::MODE_FIXED),
-		isPoolRunning_(false),
-		idleThreadSize_(0),
-		threadSizeThreadHold_(THREAD_MAX_THREADHOLD),
-		curThreadSize_(0)
+		isPoolRunning_(false)
 	{}
 
 	// ̳߳
-	~ThreadPool() {
-		isPoolRunning_ = false;
-		//notEmpty_.notify_all();
-		// ȴ̳߳е̷߳  ״̬ & ִ
+	// ִɣ̳߳زſԻе߳Դ
+	~BasicThreadPool() {
+		shutdown(ShutdownMode::DRAIN);
+	}
+
+	// ر̳߳أ֮ύ񶼻ʧ
+	// ȴtimeoutʱ̻߳ûȫ˳falseٴεüȴ
+	// ڱ̳߳صã߳ԼԶȲ˳ֱӷfalse
+	bool shutdown(ShutdownMode mode = ShutdownMode::DRAIN,
+		std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) {
+		if (WorkerIdentity::current().pool == this) {
+			std::cerr << " shutdown called from a task of the same pool, shutdown fail." << std::endl;
+			return false;
+		}
+		POOL_STRESS_POINT();
+		{
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			isShutdown_ = true;
+			if (mode == ShutdownMode::DISCARD) {
+				// 󣬶Ӧfutureյbroken_promise
+				taskQue_.clear();
+				clearProducerTasks();
+				taskSize_ = 0;
+				notFull_.notify_all();
+				idleCond_.notify_all();
+			}
+			isPoolRunning_ = false;
+			notEmpty_.notify_all();
+
+			// ȴ̳߳е̷߳  ״̬ & ִ
+			auto allExited = [&]()->bool { return curThreadSize_ == 0; };
+			if (timeout == std::chrono::milliseconds::max()) {
+				exitCond_.wait(lock, allExited);
+			}
+			else if (!exitCond_.wait_for(lock, timeout, allExited)) {
+				return false;
+			}
+		}
+
+		// ̶߳Ѿ˳join
+		// ߳ͬʱshutdownʱֻһjoin֮꣬󿴵̶߳ѾΪ
+		std::unique_lock<std::mutex> joinLock(joinMtx_);
+		for (int i = 0; i < slotCapacity_; i++) {
+			if (slots_[i].thread != nullptr) {
+				slots_[i].thread->join();
+				slots_[i].thread.reset();
+			}
+			slots_[i].state = SLOT_FREE;
+		}
+		return true;
+	}
+
+	// Ŷӵĺִеִ꣬
+	// ȴtimeoutʱ仹ûпзfalse
+	bool awaitIdle(std::chrono::milliseconds timeout = std::chrono::milliseconds::max()) {
+		POOL_STRESS_POINT();
 		std::unique_lock<std::mutex> lock(taskQueMtx_);
-		notEmpty_.notify_all();
-		/* PoolһֱΪʱsizeΪ0Ϊ̶߳滹һ߳*/
-		exitCond_.wait(lock, [&]() { return threads_.size() == 0; });
+		auto idle = [&]()->bool {
+			return taskSize_ == 0 && activeTaskSize_ == 0 && handoffSize_ == 0 && !hasProducerTasks();
+		};
+		if (timeout == std::chrono::milliseconds::max()) {
+			idleCond_.wait(lock, idle);
+			return true;
+		}
+		return idleCond_.wait_for(lock, timeout, idle);
+	}
+
+	// ̳߳ڲļǷһ£һµӡcerrfalse
+	// ʱ̵ãѹ
+	bool checkInvariants() {
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		bool ok = true;
+		auto fail = [&](const char* what, long long value, long long expect) {
+			std::cerr << " invariant fail: " << what << " = " << value << ", expect " << expect << std::endl;
+			ok = false;
+		};
+
+		int running = 0;
+		for (int i = 0; i < slotCapacity_; i++) {
+			if (slots_[i].state == SLOT_RUNNING) {
+				running++;
+			}
+		}
+		// ߳ͼֻڳʱһ޸
+		if (curThreadSize_ != running) {
+			fail("curThreadSize_", curThreadSize_, running);
+		}
+		if (curThreadSize_ > slotCapacity_) {
+			fail("curThreadSize_", curThreadSize_, slotCapacity_);
+		}
+		if (taskSize_ != (int)taskQue_.size()) {
+			fail("taskSize_", taskSize_, (long long)taskQue_.size());
+		}
+		// ִȼactiveTaskSize_˳ᳬ߳
+		if (activeTaskSize_ < 0 || activeTaskSize_ > curThreadSize_) {
+			fail("activeTaskSize_", activeTaskSize_, curThreadSize_);
+		}
+		if constexpr (SizingPolicy::dynamic) {
+			if (idleThreadSize_ < 0 || idleThreadSize_ > curThreadSize_) {
+				fail("idleThreadSize_", idleThreadSize_, curThreadSize_);
+			}
+		}
+		// ÿ̵߳һ
+		if (handoffSize_ < 0 || handoffSize_ > spinSize_) {
+			fail("handoffSize_", handoffSize_, spinSize_);
+		}
+		// ̶߳˳֮ﲻܻ
+		// ύ飬ر֮Žȥύ߳Լջ
+		if (isShutdown_ && curThreadSize_ == 0 && taskSize_ != 0) {
+			fail("taskSize_ after shutdown", taskSize_, 0);
+		}
+		return ok;
 	}
 
 	// ̳߳صĹģʽ
@@ -100,6 +765,10 @@ public:
 		if (checkRunningState()) {
 			return;
 		}
+		if (!SizingPolicy::dynamic && mode == PoolMode::MODE_CACHED) {
+			std::cerr << " fixed sizing policy does not support cached mode." << std::endl;
+			return;
+		}
 		poolMode_ = mode;
 	}
 
@@ -111,6 +780,17 @@ public:
 		taskQueMaxThreadHold_ = threadhold;
 	}
 
+	// ύ̳߳߳submitTaskύȷŽ߳ԼĻ
+	// ֱ߳ӴӻȡύʱtaskQueMtx_ֻлӿձɷǿʱż֪ͨ
+	// sizeÿ0ʾرգύ̵߳ȴ֤ͬһ߳ύȽȳ
+	// PRODUCER_MAX_SIZE߳ͬʱԼĻճŽУ߳˳󻺳ȡµ߳
+	void setProducerBufferSize(int size) {
+		if (checkRunningState()) {
+			return;
+		}
+		producerBufferSize_ = size < 0 ? 0 : size;
+	}
+
 	// ̳߳cachedģʽ̵ֵ߳
 	void setThreadSizeThreadHold(int threadhold) {
 		if (checkRunningState())
@@ -120,106 +800,413 @@ public:
 		}
 	}
 
+	// ù̵߳ջС0ʾϵͳĬϣlinuxһ8MBWindowsϲЧ
+	// ̶߳ʱСԴռõڴ
+	void setThreadStackSize(size_t size) {
+		if (checkRunningState()) {
+			return;
+		}
+		threadStackSize_ = size;
+	}
+
+	// ù߳ջıҳС0ʾϵͳĬϣWindowsϲЧ
+	void setThreadGuardSize(size_t size) {
+		if (checkRunningState()) {
+			return;
+		}
+		threadGuardSize_ = size;
+	}
+
+	// postύ׳쳣ʱĴִĹ߳ϵ
+	// ʱӡcerr
+	void setExceptionHandler(std::function<void(std::exception_ptr)> handler) {
+		if (checkRunningState()) {
+			return;
+		}
+		exceptionHandler_ = std::move(handler);
+	}
+
+	// ù߳ǰ׺߳"ǰ׺-߳±"pool-3ַʾ
+	void setThreadName(const std::string& prefix) {
+		if (checkRunningState()) {
+			return;
+		}
+		threadNamePrefix_ = prefix;
+	}
+
+	// ӳstarṭ߳ŶӶ̲߳ʱinitThreadSize
+	// ̺߳ܶʱstart
+	void setLazyStart(bool lazy) {
+		if (checkRunningState()) {
+			return;
+		}
+		lazyStart_ = lazy;
+	}
+
+	// ̵߳start߳ǰsizeȡ
+	// һֱæԼ䣬ύ̰߳Ĭֱде䣬Ҳû
+	// ̶߳æʱճŽУҪһͨ߳
+	// ֱӽ̵ܱ߳ύŶӵִ
+	// ̻߳һֱռһcpuˣֻʺ϶ӳٷǳСĳ
+	void setSpinWorkerSize(int size) {
+		if (checkRunningState()) {
+			return;
+		}
+		spinSize_ = size < 0 ? 0 : size;
+	}
+
+	// һ飬idTASK_MAX_GROUPS-1
+	// weightǵȨأ̰߳Ȩڸ֮תȡ
+	// maxConcurrencyƸͬʱִе0ʾ
+	// queMaxThreadHoldǸ޵ֵ0ʾsetTaskQueMaxThreadHoldֵ
+	int createTaskGroup(int weight = 1, int maxConcurrency = 0, int queMaxThreadHold = 0) {
+		static_assert(QueuePolicy::groups, "task groups need a queue policy with groups, e.g. FairShareQueue");
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		int id = taskQue_.createGroup(weight, maxConcurrency, queMaxThreadHold);
+		if (id < 0) {
+			std::cerr << " too many task groups,create task group fail." << std::endl;
+		}
+		return id;
+	}
+
+	// ȡͳϢ
+	TaskGroupStats getTaskGroupStats(int group) {
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		TaskGroupStats stats{};
+		if (!taskQue_.hasGroup(group)) {
+			return stats;
+		}
+		metrics_.fill(group, stats);
+		stats.queued = taskQue_.queued(group) + (group == 0 ? producerQueued() : 0);
+		if constexpr (QueuePolicy::groups) {
+			stats.running = taskQue_.running(group);
+		}
+		else {
+			stats.running = activeTaskSize_;
+		}
+		return stats;
+	}
+
 	// ̳߳ύ
 	// ʹÿɱģ̣submitTaskԽ⺯Ĳ
 	template <typename Func,typename... Args>
 	auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))> {
-		// 񣬷
-		using RType = decltype(func(args...));   // Ƶһ
-		auto task = std::make_shared<std::packaged_task<RType()>>(
-			std::bind(std::forward<Func>(func), std::forward<Args>(args)...)
-			);
-		std::future<RType> result = task->get_future();
+		return submitGroupTask(0, std::forward<Func>(func), std::forward<Args>(args)...);
+	}
 
-		// ȡ
-		std::unique_lock<std::mutex> lock(taskQueMtx_);
-		// ̵߳ͨ ȴп
-		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
-			[&]()->bool {return taskQue_.size() < (size_t)taskQueMaxThreadHold_; })) {
-			// ʾnotFullȴ1sȻû
-			std::cerr << " task queue id full,submit task fail." << std::endl;
-			auto task = std::make_shared<std::packaged_task<RType()>>(
-				[]()->RType {return RType(); });
-			(* task)();
-			return task->get_future();
+	// ָύ
+	template <typename Func, typename... Args>
+	auto submitGroupTask(int group, Func&& func, Args&&... args) -> std::future<decltype(func(args...))> {
+		return submitTaskImpl(group, typeid(std::decay_t<Func>).name(),
+			std::forward<Func>(func), std::forward<Args>(args)...);
+	}
+
+	// ύǩǩܣtagҪһֱЧһַ
+	template <typename Func, typename... Args>
+	auto submitTaggedTask(const char* tag, Func&& func, Args&&... args) -> std::future<decltype(func(args...))> {
+		return submitTaskImpl(0, tag, std::forward<Func>(func), std::forward<Args>(args)...);
+	}
+
+	// ύҪ񣬲promisefutureύʧܷfalse
+	// ׳쳣setExceptionHandlerõĴ
+	template <typename Func, typename... Args>
+	bool post(Func&& func, Args&&... args) {
+		return postGroupTask(0, std::forward<Func>(func), std::forward<Args>(args)...);
+	}
+
+	// ָύҪ
+	template <typename Func, typename... Args>
+	bool postGroupTask(int group, Func&& func, Args&&... args) {
+		return enqueueTask(PoolTask([this, fn = std::bind(std::forward<Func>(func), std::forward<Args>(args)...)]() mutable {
+			try {
+				fn();
+			}
+			catch (...) {
+				handleException(std::current_exception());
+			}
+			}, typeid(std::decay_t<Func>).name()), group);
+	}
+
+	// n߳ͬʱִfunc(idx, barrier)idx0n-10ɵ߳ԼִУȫ󷵻
+	// ѭдfuncÿһ֮barrier.wait()ͬÿһύ͵ȴfuture
+	// n-1Ϊ񽻸̣߳ҪͬʱУ̲߳ʱfalse
+	// ̱߳ռʱҪǿճܿʼ
+	// ĳ߳׳쳣ʱ˳ϣִ̼߳Уȫѵһ쳣׸
+	template <typename Func>
+	bool parallelRegion(int n, Func&& func) {
+		int limit = availableWorkerSize();
+		if (n < 1 || n - 1 > limit) {
+			std::cerr << " parallel region needs " << n - 1 << " workers, only " << limit
+				<< " available, run parallel region fail." << std::endl;
+			return false;
 		}
 
-		// п࣬
-		//taskQue_.emplace(sp);
-		taskQue_.emplace([task]() {
-			// ȥִ
-			(*task)();
-			});
-		taskSize_++;
-		// Ϊ·п϶ˣnotEmpyt_ ִ֪ͨ߳
-		notEmpty_.notify_all();
+		SpinBarrier barrier(n);
+		std::exception_ptr error;
+		std::mutex mtx;
+		std::condition_variable doneCond;
+		std::atomic_int remaining(n - 1);   // ûĹ߳
+		auto fail = [&](std::exception_ptr e) {
+			std::unique_lock<std::mutex> lock(mtx);
+			if (!error) {
+				error = e;
+			}
+		};
+		auto run = [&](int idx) {
+			try {
+				func(idx, barrier);
+			}
+			catch (...) {
+				fail(std::current_exception());
+				barrier.arriveAndDrop();
+			}
+		};
+		// ߳õ֮Ż᷵أﻹŵʱپֲ
+		auto finish = [&]() {
+			std::unique_lock<std::mutex> lock(mtx);
+			if (--remaining == 0) {
+				doneCond.notify_all();
+			}
+		};
 
-		// cachedģʽ ҪͿ̵߳жǷҪµ̣߳
-		// ȽϽ񣬳С
-		if (poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ &&
-			curThreadSize_ < threadSizeThreadHold_) {
-			std::cout << ">>>>>>>>> create new thread..." << std::endl;
-			// µ߳
-			auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-			int threadId = ptr->getId();
-			threads_.emplace(threadId, std::move(ptr));
-			// ߳
-			threads_[threadId]->start();
-			// ޸̸߳صı
-			curThreadSize_++;
-			idleThreadSize_++;   // ߳Ϊ߳
-			//threads_.emplace_back(std::move(ptr));
+		for (int i = 1; i < n; i++) {
+			// ύʧܻ߱DISCARDرն߳һʼ˳
+			TaskDropGuard guard([&]() {
+				fail(std::make_exception_ptr(std::runtime_error("task dropped, parallel region incomplete")));
+				barrier.arriveAndDrop();
+				finish();
+				});
+			enqueueTask(PoolTask([&run, &finish, i, guard = std::move(guard)]() mutable {
+				guard.dismiss();
+				run(i);
+				finish();
+				}, typeid(std::decay_t<Func>).name()));
 		}
+		run(0);
 
-		// Result
-		return result;
+		// ߳̽˯
+		for (int i = 0; i < SpinBarrier::defaultSpinCount() && remaining.load() != 0; i++) {
+			cpuRelax();
+		}
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			doneCond.wait(lock, [&]()->bool { return remaining == 0; });
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return true;
+	}
+
+	// ͳƲԶProfiledMetricsͨȡĽ
+	MetricsPolicy& getMetrics() {
+		return metrics_;
+	}
+
+	// ǰ̵߳ʱڴ棬ڴͷ
+	// ִֻ̳߳еʹ
+	static ScratchArena& workerAllocator() {
+		return ScratchArena::local();
+	}
+
+	// ǰ̵߳±꣬Χ[0, workerCapacity())̳߳ص̷߳-1
+	// ±̵߳Ĳλcachedģʽ»յ̺߳͸λ߳±ͬ
+	static int currentWorkerIndex() {
+		return WorkerIdentity::current().index;
+	}
+
+	// ǰ߳Ǳ̳߳صĹ߳ʱ±꣬򷵻-1
+	int localWorkerIndex() const {
+		const WorkerIdentity& identity = WorkerIdentity::current();
+		return identity.pool == this ? identity.index : -1;
+	}
+
+	// ߳±ޣstart֮Ч
+	int workerCapacity() const {
+		return slotCapacity_;
+	}
+
+	// ͬʱռù̵߳ޣûʱ0
+	// ̵ͨ߳cachedģʽ߳㣩߳Ǳ̳߳صĹ߳ʱԼ
+	int availableWorkerSize() const {
+		if (!isPoolRunning_) {
+			return 0;
+		}
+		int limit = (poolMode_ == PoolMode::MODE_CACHED ? threadSizeThreadHold_ : initThreadSize_) - spinSize_;
+		if (WorkerIdentity::current().pool == this) {
+			limit--;   // ̱߳ǹ߳
+		}
+		return limit;
 	}
 
 	// ̳߳   // ǰϵͳcpuĺ
 	void start(int initThreadSize = std::thread::hardware_concurrency()) {
+		if (checkRunningState() || isShutdown_) {
+			return;
+		}
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
 		// ̳߳ص״̬
 		isPoolRunning_ = true;
 		// ¼ʼ̵߳ĸ
 		initThreadSize_ = initThreadSize;
-		curThreadSize_ = initThreadSize;
 
-		// ̶߳
-		for (int i = 0; i < initThreadSize_; i++) {
-			// 󶨣ThreadstartͿԵ ThreadPoolthreadFunc
-			//threads_.emplace_back(new Thread(std::bind(&ThreadPool::threadFunc,this)));
-			auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-			int threadId = ptr->getId();
-			threads_.emplace(threadId, std::move(ptr));
-			//threads_.emplace_back(std::move(ptr));
+		// ̲߳λ̶cachedģʽ߳޷
+		slotCapacity_ = initThreadSize_;
+		if (poolMode_ == PoolMode::MODE_CACHED && threadSizeThreadHold_ > slotCapacity_) {
+			slotCapacity_ = threadSizeThreadHold_;
 		}
+		slots_ = std::make_unique<WorkerSlot[]>(slotCapacity_);
 
-		// ߳
-		for (int i = 0; i < initThreadSize_; i++) {
-			threads_[i]->start();   // Ҫִһ̺߳
-			idleThreadSize_++;   // ¼ʼ̵߳
+		// ߳ȴռǰspinSize_λӳʱҲ
+		if (spinSize_ >= initThreadSize_) {
+			std::cerr << " spin worker size must be less than thread size, use " << initThreadSize_ - 1 << std::endl;
+			spinSize_ = initThreadSize_ > 0 ? initThreadSize_ - 1 : 0;
+		}
+		mailboxes_ = std::make_unique<Mailbox[]>(spinSize_);
+		for (int i = 0; i < spinSize_; i++) {
+			spawnWorker(true);
+		}
+
+		// ̣߳ӳĵȵʱٴ
+		if (lazyStart_) {
+			return;
+		}
+		for (int i = spinSize_; i < initThreadSize_; i++) {
+			spawnWorker();
 		}
 	}
 
 	// ֹ͸ֵ
-	ThreadPool(const ThreadPool&) = delete;
-	ThreadPool& operator=(const ThreadPool&) = delete;
+	BasicThreadPool(const BasicThreadPool&) = delete;
+	BasicThreadPool& operator=(const BasicThreadPool&) = delete;
 
 private:
-	// ̺߳
-	void threadFunc(int threadid) {
+	// һⲿ̵߳ύߵĻζ
+	// tailֻύ߳дheadֻгtaskQueMtx_Ĺ߳д
+	struct ProducerQueue {
+		explicit ProducerQueue(int size) :capacity(size), slots(std::make_unique<PoolTask[]>(size)) {}
+
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{ 0 };
+		alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{ 0 };
+		size_t capacity;
+		std::unique_ptr<PoolTask[]> slots;
+		std::atomic_bool owned{ true };   // ύ̻߳û˳
+	};
+
+	// ύ̳߳еĻ߳˳ʱȥȡ֮µύ̸߳
+	// ̳߳ʱͷ
+	struct LocalProducers {
+		std::unordered_map<uint64_t, std::shared_ptr<ProducerQueue>> queues;   // ̳߳رŲ
+
+		~LocalProducers() {
+			for (auto& item : queues) {
+				item.second->owned.store(false, std::memory_order_release);
+			}
+		}
+	};
+
+	// ύΪĬһԴвԣһת
+	struct ProducerSource {
+		BasicThreadPool& pool;
+		bool taken;     // ȡǷύtaskSize_
+
+		bool hasTasks() const {
+			return pool.hasProducerTasks();
+		}
+		bool pop(PoolTask& task) {
+			taken = pool.popProducerTask(task);
+			return taken;
+		}
+	};
+
+	// 񣬷Ķ
+	template <typename Func, typename... Args>
+	auto submitTaskImpl(int group, const char* tag, Func&& func, Args&&... args) -> std::future<decltype(func(args...))> {
+		// promiseĹ״̬ӱ̵߳TaskArena䣬ִɹ̳߳
+		using RType = decltype(func(args...));   // Ƶһ
+		std::promise<RType> promise(std::allocator_arg, ArenaAllocator<RType>());
+		std::future<RType> result = promise.get_future();
+
+		if (!enqueueTask(PoolTask([fn = std::bind(std::forward<Func>(func), std::forward<Args>(args)...),
+			promise = std::move(promise)]() mutable {
+			// ȥִ
+			try {
+				if constexpr (std::is_void<RType>::value) {
+					fn();
+					promise.set_value();
+				}
+				else {
+					promise.set_value(fn());
+				}
+			}
+			catch (...) {
+				promise.set_exception(std::current_exception());
+			}
+			}, tag), group)) {
+			auto task = std::make_shared<std::packaged_task<RType()>>(
+				[]()->RType {return RType(); });
+			(* task)();
+			return task->get_future();
+		}
+
+		// Result
+		return result;
+	}
+
+	// û˵ȴ׳쳣
+	void handleException(std::exception_ptr error) {
+		if (exceptionHandler_) {
+			try {
+				exceptionHandler_(error);
+			}
+			catch (...) {
+				std::cerr << " exception handler throw exception." << std::endl;
+			}
+			return;
+		}
+		try {
+			std::rethrow_exception(error);
+		}
+		catch (const std::exception& e) {
+			std::cerr << " task throw exception: " << e.what() << std::endl;
+		}
+		catch (...) {
+			std::cerr << " task throw unknown exception." << std::endl;
+		}
+	}
+
+	// ɶк΢ƹpackaged_taskֱͶ
+	template<typename T, typename Pool>
+	friend class CompletionQueue;
+	template<typename Key, typename In, typename Out, typename Pool>
+	friend class Batcher;
+
+	// ̺߳slot߳ڲλ±
+	void threadFunc(int slot) {
 		auto lastTime = std::chrono::high_resolution_clock().now();
+		ScratchArena& scratch = ScratchArena::local();
+		WorkerIdentity::current() = { this, slot };
 
 
 		// ִɣ̳߳زſԻе߳Դ
 		// while (isPoolRunning_)
 		for (;;) {
-			//std::shared_ptr<Task> task;
 			Task task;
+			int group = 0;
+			ProducerSource producers{ *this, false };
+
+			POOL_STRESS_POINT();
+			// ȴһ
+			WaitPolicy::spin([&]()->bool { return taskSize_ > 0 || !isPoolRunning_; });
 			{
 				// ȡ
+				uint64_t lockBegin = TaskTracer::enabled() ? TaskTracer::now() : 0;
 				std::unique_lock<std::mutex> lock(taskQueMtx_);
+				if (lockBegin != 0) {
+					TaskTracer::record(TraceEvent::LOCK, lockBegin, nullptr, slot);
+				}
 
-				std::cout << "tid: " << std::this_thread::get_id() << "Իȡ..." << std::endl;
+				POOL_LOG("tid: " << std::this_thread::get_id() << "Իȡ...");
 
 				// cachedģʽ£пѾ˺̣ܶ߳ǿ¼60sӦðѶ̻߳յ
 				// initThreadsize_߳Ҫл
@@ -228,44 +1215,50 @@ private:
 				// ôǳʱػ񷵻
 
 				// +˫ж
-				while (isPoolRunning_ && taskQue_.size() == 0) {
-					if (poolMode_ == PoolMode::MODE_CACHED) {
-						// ʱ
-						if (std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1))) {
-							auto now = std::chrono::high_resolution_clock().now();
-							auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-							if (dur.count() >= 60 && curThreadSize_ > initThreadSize_) {
-								// յǰ߳
-								// ¼߳رֵ
-								// ̶߳߳бɾ
-								// ûа취threadFuncThread
-								// threadid -> thread->ɾ
-								threads_.erase(threadid);   // Ҫʹstd::this_thread::getid()
-								curThreadSize_--;
-								idleThreadSize_--;
-								std::cout << "threadid:" << std::this_thread::get_id() << "exit!" << std::endl;
-								return;
+				// ر֮ҪŶӵִ˳
+				while (!taskQue_.pop(task, group, producers) && (isPoolRunning_ || taskSize_ > 0)) {
+					if constexpr (SizingPolicy::dynamic) {
+						if (poolMode_ == PoolMode::MODE_CACHED) {
+							// ʱ
+							TaskArena::flushRemote();
+							if (std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1))) {
+								auto now = std::chrono::high_resolution_clock().now();
+								auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
+								if (dur.count() >= THREAD_MAX_IDLE_TIME && curThreadSize_ > initThreadSize_) {
+									// յǰ߳
+									// ¼߳رֵ
+									// λΪ˳ɸòλ̻߳shutdownjoin
+									workerExit(slot);
+									POOL_LOG("threadid:" << std::this_thread::get_id() << "exit!");
+									return;
+								}
 							}
+							continue;
 						}
 					}
-					else {
-						// ȴnotEmpty
-						notEmpty_.wait(lock);
-					}
+					// ȴnotEmpty˯֮ǰŵڴ滹ȥ
+					TaskArena::flushRemote();
+					notEmpty_.wait(lock);
 				}
-				if (!isPoolRunning_) {
+				if (!task) {
+					POOL_STRESS_POINT();
+					workerExit(slot);
 					break;
 				}
-				idleThreadSize_--;
+				TaskTracer::record(TraceEvent::DEQUEUE, task.traceId(), task.tag(), group);
+				if constexpr (SizingPolicy::dynamic) {
+					idleThreadSize_--;
+				}
+				activeTaskSize_++;
 
-				std::cout << "tid: " << std::this_thread::get_id() << "ȡɹ..." << std::endl;
-				// ȡһ
-				task = taskQue_.front();
-				taskQue_.pop();
-				taskSize_--;
+				POOL_LOG("tid: " << std::this_thread::get_id() << "ȡɹ...");
+				// ύȡtaskSize_
+				if (!producers.taken) {
+					taskSize_--;
+				}
 
 				// Ȼʣ񣬼ִ֪ͨ߳
-				if (taskQue_.size() > 0) {
+				if (taskSize_ > 0) {
 					notEmpty_.notify_all();
 				}
 
@@ -275,50 +1268,478 @@ private:
 			}// ͷ
 
 			// ǰ̸ִ߳
-			if (task != nullptr) {
-				task();   // ִfunction<void()>
+			typename MetricsPolicy::Probe probe = metrics_.beginTask(slot);
+			TaskTracer::record(TraceEvent::START, task.traceId(), task.tag(), slot);
+			task();   // ִfunction<void()>
+			TaskTracer::record(TraceEvent::FINISH, task.traceId(), task.tag(), slot);
+			metrics_.endTask(probe, task, slot);
+			task.reset();
+			scratch.reset();
+			POOL_STRESS_POINT();
+
+			metrics_.onComplete(group);
+			if (taskQue_.release(group)) {
+				// в޵ڳŶӵԼ
+				std::unique_lock<std::mutex> lock(taskQueMtx_);
+				if (taskQue_.hasQueued(group)) {
+					notEmpty_.notify_all();
+				}
+			}
+			if constexpr (SizingPolicy::dynamic) {
+				idleThreadSize_++;
+			}
+			POOL_STRESS_POINT();
+			if (--activeTaskSize_ == 0) {
+				// ֪ͨawaitIdleû˯ʱʧ֪ͨ
+				std::unique_lock<std::mutex> lock(taskQueMtx_);
+				if (taskSize_ == 0 && !hasProducerTasks()) {
+					idleCond_.notify_all();
+				}
+			}
+			if constexpr (SizingPolicy::dynamic) {
+				// ִ߳ʱ
+				lastTime = std::chrono::high_resolution_clock().now();
 			}
-			idleThreadSize_++;
-			// ִ߳ʱ
-			auto lastTime = std::chrono::high_resolution_clock().now();
 		}
 		// ̵߳
 		// һ֣ԭ߳̾
 		// һִ֣߳
-		// 
-		threads_.erase(threadid);   // Ҫʹstd::this_thread::getid()
-		std::cout << "threadid:" << std::this_thread::get_id() << "exit!" << std::endl;
+		POOL_LOG("threadid:" << std::this_thread::get_id() << "exit!");
+	}
+
+	// ̵߳ĺslotҲ±
+	void spinFunc(int slot) {
+		ScratchArena& scratch = ScratchArena::local();
+		WorkerIdentity::current() = { this, slot };
+		Mailbox& box = mailboxes_[slot];
+		box.state.store(MAILBOX_EMPTY, std::memory_order_release);
+
+		int idle = 0;
+		for (;;) {
+			int state = box.state.load(std::memory_order_acquire);
+			if (state == MAILBOX_FULL) {
+				Task task = std::move(box.task);
+				typename MetricsPolicy::Probe probe = metrics_.beginTask(slot);
+				TaskTracer::record(TraceEvent::START, task.traceId(), task.tag(), slot);
+				task();
+				TaskTracer::record(TraceEvent::FINISH, task.traceId(), task.tag(), slot);
+				metrics_.endTask(probe, task, slot);
+				task.reset();
+				scratch.reset();
+				metrics_.onComplete(0);
+				// ȼڳ䣬ᳬ̵߳
+				bool last = --handoffSize_ == 0;
+				POOL_STRESS_POINT();
+				box.state.store(MAILBOX_EMPTY, std::memory_order_release);
+				if (last) {
+					std::unique_lock<std::mutex> lock(taskQueMtx_);
+					if (taskSize_ == 0 && activeTaskSize_ == 0 && !hasProducerTasks()) {
+						idleCond_.notify_all();
+					}
+				}
+				idle = 0;
+				continue;
+			}
+			if (state == MAILBOX_EMPTY && !isPoolRunning_) {
+				// ر֮ǿյĲ˳Ѿճִ
+				if (box.state.compare_exchange_strong(state, MAILBOX_STOP)) {
+					std::unique_lock<std::mutex> lock(taskQueMtx_);
+					workerExit(slot);
+					return;
+				}
+				continue;
+			}
+			if (++idle < SPIN_MAX_COUNT) {
+				cpuRelax();
+				continue;
+			}
+			// ÿSPIN_MAX_COUNTóһcpu˲ʱ߳ҲУ˳ŵڴ滹ȥ
+			idle = 0;
+			TaskArena::flushRemote();
+			std::this_thread::yield();
+		}
+	}
+
+	// ֱӽһе̣߳æfalsetask
+	bool handOff(PoolTask& task) {
+		thread_local int hint = 0;   // һν䣬´δʼ
+		for (int i = 0; i < spinSize_; i++) {
+			int k = (hint + i) % spinSize_;
+			Mailbox& box = mailboxes_[k];
+			int state = MAILBOX_EMPTY;
+			if (box.state.load(std::memory_order_relaxed) != MAILBOX_EMPTY ||
+				!box.state.compare_exchange_strong(state, MAILBOX_CLAIMED, std::memory_order_acquire)) {
+				continue;
+			}
+			handoffSize_++;
+			POOL_STRESS_POINT();
+			TaskTracer::record(TraceEvent::ENQUEUE, task.traceId(), task.tag(), 0);
+			metrics_.onSubmit(0);
+			box.task = std::move(task);
+			box.state.store(MAILBOX_FULL, std::memory_order_release);
+			hint = k;
+			return true;
+		}
+		return false;
+	}
+
+	// ռһеĲλ̣߳λ귵falseҪtaskQueMtx_
+	// dedicatedʾ߳
+	bool spawnWorker(bool dedicated = false) {
+		// ǰspinSize_λ߳
+		for (int i = dedicated ? 0 : spinSize_; i < slotCapacity_; i++) {
+			WorkerSlot& slot = slots_[i];
+			int state = slot.state.load();
+			if (state == SLOT_RUNNING || !slot.state.compare_exchange_strong(state, SLOT_RUNNING)) {
+				continue;
+			}
+			// λѾ˳̣߳Ȼ
+			if (slot.thread != nullptr) {
+				slot.thread->join();
+			}
+			std::string name = threadNamePrefix_.empty() ? "" : threadNamePrefix_ + "-" + std::to_string(i);
+			slot.thread = std::make_unique<Thread>([this, i, dedicated](int) {
+				if (dedicated) {
+					spinFunc(i);
+				}
+				else {
+					threadFunc(i);
+				}
+				}, name, threadStackSize_, threadGuardSize_);
+			TaskTracer::record(TraceEvent::SPAWN, 0, nullptr, i);
+			POOL_STRESS_POINT();
+			curThreadSize_++;
+			if constexpr (SizingPolicy::dynamic) {
+				if (!dedicated) {
+					idleThreadSize_++;   // ߳Ϊ߳
+				}
+			}
+			if (!slot.thread->start()) {
+				// ʧܣλȥ̵߳һֱMAILBOX_STOP񽻹
+				curThreadSize_--;
+				if constexpr (SizingPolicy::dynamic) {
+					if (!dedicated) {
+						idleThreadSize_--;
+					}
+				}
+				slot.thread.reset();
+				slot.state = SLOT_FREE;
+				return false;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// Ŷӵȿ̶߳ٴһ̣߳ҪtaskQueMtx_
+	// ӳʱಹinitThreadSize_cachedģʽݵthreadSizeThreadHold_
+	// queuedҪύ̲߳ȡ񣬲ڿ߳
+	void spawnOnDemand(size_t queued) {
+		if (lazyStart_ && isPoolRunning_ && curThreadSize_ < initThreadSize_ &&
+			(int)queued > curThreadSize_ - spinSize_ - activeTaskSize_) {
+			spawnWorker();
+			return;
+		}
+		// cachedģʽ ҪͿ̵߳жǷҪµ̣߳
+		// ȽϽ񣬳С
+		if constexpr (SizingPolicy::dynamic) {
+			if (poolMode_ == PoolMode::MODE_CACHED && isPoolRunning_ && (int)queued > idleThreadSize_ &&
+				curThreadSize_ < threadSizeThreadHold_) {
+				POOL_LOG(">>>>>>>>> create new thread...");
+				// µ߳
+				spawnWorker();
+			}
+		}
+	}
+
+	// ߳˳ǰļ¼ҪtaskQueMtx_
+	void workerExit(int slot) {
+		curThreadSize_--;
+		if constexpr (SizingPolicy::dynamic) {
+			if (slot >= spinSize_) {
+				idleThreadSize_--;
+			}
+		}
+		slots_[slot].state = SLOT_EXITED;
+		TaskTracer::record(TraceEvent::EXIT, 0, nullptr, slot);
 		exitCond_.notify_all();
 	}
 
+	// ĶУȴ1sȻûп෵false
+	bool enqueueTask(PoolTask task, int group = 0) {
+		// Ĭֱӽе߳
+		if (spinSize_ > 0 && group == 0 && !isShutdown_ && handOff(task)) {
+			return true;
+		}
+
+		// ⲿ߳ύĬȷŽԼύ
+		if (producerBufferSize_ > 0 && group == 0 && WorkerIdentity::current().pool != this) {
+			ProducerQueue* queue = localProducerQueue();
+			if (queue != nullptr) {
+				return pushProducerTask(*queue, std::move(task));
+			}
+		}
+
+		POOL_STRESS_POINT();
+		// ȡ
+		std::unique_lock<std::mutex> lock(taskQueMtx_);
+		if (!taskQue_.hasGroup(group)) {
+			std::cerr << " task group " << group << " not exist,submit task fail." << std::endl;
+			return false;
+		}
+		// ̵߳ͨ ȴп
+		// ȴʱͷ̳߳ؿڼ䱻رգ߳ȫ˳ٷŽȥûִ
+		if (!notFull_.wait_for(lock, std::chrono::seconds(1),
+			[&]()->bool {return isShutdown_ || !taskQue_.full(group, (size_t)taskQueMaxThreadHold_); })) {
+			// ʾnotFullȴ1sȻû
+			std::cerr << " task queue id full,submit task fail." << std::endl;
+			metrics_.onReject(group);
+			return false;
+		}
+		if (isShutdown_) {
+			std::cerr << " thread pool is shut down,submit task fail." << std::endl;
+			return false;
+		}
+
+		// п࣬
+		TaskTracer::record(TraceEvent::ENQUEUE, task.traceId(), task.tag(), group);
+		taskQue_.push(group, std::move(task));
+		metrics_.onSubmit(group);
+		taskSize_++;
+		// Ϊ·п϶ˣnotEmpyt_ ִ֪ͨ߳
+		notEmpty_.notify_all();
+
+		spawnOnDemand(taskSize_ + producerQueued());
+		return true;
+	}
+
+	// ̳߳߳ύһύʱ귵nullptr
+	// ȸ˳߳²ѾȡյĻûõʱ֮߳˳ȡ
+	ProducerQueue* localProducerQueue() {
+		thread_local LocalProducers local;
+		auto it = local.queues.find(poolId_);
+		if (it != local.queues.end()) {
+			return it->second.get();
+		}
+		std::shared_ptr<ProducerQueue> queue;
+		{
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			int n = producerSize_.load();
+			for (int i = 0; i < n; i++) {
+				ProducerQueue& old = *producers_[i];
+				if (!old.owned.load(std::memory_order_acquire) && old.head.load() == old.tail.load()) {
+					old.owned.store(true);
+					queue = producers_[i];
+					break;
+				}
+			}
+			if (queue == nullptr && n < PRODUCER_MAX_SIZE) {
+				producers_[n] = std::make_shared<ProducerQueue>(producerBufferSize_);
+				queue = producers_[n];
+				producerSize_.store(n + 1);
+			}
+		}
+		if (queue == nullptr) {
+			return nullptr;
+		}
+		// ֻʣõĻѾ̳߳أ˳ͷ
+		for (auto dead = local.queues.begin(); dead != local.queues.end();) {
+			if (dead->second.use_count() == 1) {
+				dead = local.queues.erase(dead);
+			}
+			else {
+				++dead;
+			}
+		}
+		local.queues.emplace(poolId_, queue);
+		return queue.get();
+	}
+
+	// ύ̷ֻ߳дԼĻ
+	bool pushProducerTask(ProducerQueue& queue, PoolTask&& task) {
+		if (isShutdown_) {
+			std::cerr << " thread pool is shut down,submit task fail." << std::endl;
+			return false;
+		}
+		size_t tail = queue.tail.load(std::memory_order_relaxed);
+		if (tail - queue.head.load(std::memory_order_acquire) >= queue.capacity) {
+			// ˣʱһ1s
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			if (!notFull_.wait_for(lock, std::chrono::seconds(1),
+				[&]()->bool { return tail - queue.head.load() < queue.capacity; })) {
+				std::cerr << " task queue id full,submit task fail." << std::endl;
+				metrics_.onReject(0);
+				return false;
+			}
+		}
+		TaskTracer::record(TraceEvent::ENQUEUE, task.traceId(), task.tag(), 0);
+		// Ĭģ֮ǰύ
+		metrics_.onSubmit(0);
+		queue.slots[tail % queue.capacity] = std::move(task);
+		// ȷtailٿhead͹߳ȸheadٿtail(seq_cst)
+		// Ҫô߳ܿҪô￴ձȡգҪ֪ͨ
+		queue.tail.store(tail + 1);
+		POOL_STRESS_POINT();
+		if (isShutdown_) {
+			// ̳֮߳ررˣ߳̿Ѿȫ˳û˻ȡ
+			// ߳˳ǰҪȷϻǿյģ߳̾һȡ
+			// ̲߳ӻȡ񣬲
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			for (int i = spinSize_; i < slotCapacity_; i++) {
+				if (slots_[i].state == SLOT_RUNNING) {
+					notEmpty_.notify_all();
+					return true;
+				}
+			}
+			// ߳˳ǰѾȡǾύɹ
+			if (queue.head.load() > tail) {
+				return true;
+			}
+			// ʣµڹر֮Žģֻб̻߳дһջ
+			while (queue.head.load() != queue.tail.load()) {
+				size_t head = queue.head.load();
+				queue.slots[head % queue.capacity].reset();
+				queue.head.store(head + 1);
+			}
+			std::cerr << " thread pool is shut down,submit task fail." << std::endl;
+			return false;
+		}
+		if (queue.head.load() == tail) {
+			std::unique_lock<std::mutex> lock(taskQueMtx_);
+			notEmpty_.notify_all();
+			spawnOnDemand(taskSize_ + producerQueued());
+		}
+		return true;
+	}
+
+	// ̴߳ύȡҪtaskQueMtx_
+	bool popProducerTask(PoolTask& task) {
+		int n = producerSize_.load(std::memory_order_relaxed);
+		for (int i = 0; i < n; i++) {
+			ProducerQueue& queue = *producers_[(producerCursor_ + i) % n];
+			size_t head = queue.head.load(std::memory_order_relaxed);
+			if (head == queue.tail.load()) {
+				continue;
+			}
+			task = std::move(queue.slots[head % queue.capacity]);
+			queue.head.store(head + 1);
+			producerCursor_ = (producerCursor_ + i + 1) % n;
+			// ﻹ񣬽߳һȡʱ
+			// ȡ̻߳ڿ߳ҪִеҲ
+			size_t queued = producerQueued();
+			if (queued > 0) {
+				notEmpty_.notify_all();
+				spawnOnDemand(taskSize_ + queued + 1);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	// ύǷҪtaskQueMtx_
+	bool hasProducerTasks() const {
+		int n = producerSize_.load(std::memory_order_relaxed);
+		for (int i = 0; i < n; i++) {
+			if (producers_[i]->head.load() != producers_[i]->tail.load()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// ύҪtaskQueMtx_
+	size_t producerQueued() const {
+		size_t n = 0;
+		for (int i = 0; i < producerSize_.load(std::memory_order_relaxed); i++) {
+			n += producers_[i]->tail.load() - producers_[i]->head.load();
+		}
+		return n;
+	}
+
+	// ύҪtaskQueMtx_
+	void clearProducerTasks() {
+		PoolTask task;
+		while (popProducerTask(task)) {
+			task.reset();
+		}
+	}
+
+	static uint64_t nextPoolId() {
+		static std::atomic<uint64_t> id(0);
+		return ++id;
+	}
+
 	// pool״̬
 	bool checkRunningState() const {
 		return isPoolRunning_;
 	}
 
 private:
-	//std::vector<std::unique_ptr<Thread>> threads_;   // ߳б
-	std::unordered_map<int, std::unique_ptr<Thread>> threads_;
+	using Task = PoolTask;
+
+	// ̲߳λ״̬
+	enum SlotState {
+		SLOT_FREE,       // 
+		SLOT_RUNNING,    // ߳
+		SLOT_EXITED      // ߳Ѿ˳ûjoin
+	};
+
+	// ߳״̬
+	enum MailboxState {
+		MAILBOX_STOP,      // ߳û
+		MAILBOX_EMPTY,     // ߳̿
+		MAILBOX_CLAIMED,   // ύ߳䣬д
+		MAILBOX_FULL       // дˣ߳ȡִ
+	};
+
+	// һ̵߳䣬״̬ͬһֻдһ
+	struct alignas(CACHE_LINE_SIZE) Mailbox {
+		std::atomic_int state{ MAILBOX_STOP };
+		PoolTask task;
+	};
+
+	// ̲߳λ߳ȸ˳̵߳Ĳλ
+	struct WorkerSlot {
+		std::atomic_int state{ SLOT_FREE };
+		std::unique_ptr<Thread> thread;
+	};
+
+	std::unique_ptr<WorkerSlot[]> slots_;   // ̶̲߳λ
+	int slotCapacity_;               // λ
+	size_t threadStackSize_;         // ̵߳ջС
+	size_t threadGuardSize_;         // ߳ջıҳС
+	std::string threadNamePrefix_;   // ߳ǰ׺
+	bool lazyStart_;                 // ʱŴ߳
+	std::function<void(std::exception_ptr)> exceptionHandler_;   // postύ׳쳣
+	int spinSize_;                   // ̵߳ռǰspinSize_λ
+	std::unique_ptr<Mailbox[]> mailboxes_;   // ÿ߳һ
+	std::atomic_int handoffSize_;    // ̻߳ûִ
 	int initThreadSize_;			 // ʼ߳
 	int threadSizeThreadHold_;        // ߳޵ֵ
 	std::atomic_int curThreadSize_;  // ¼ǰ̵̳߳߳
-	std::atomic_int idleThreadSize_;	// ¼̵߳
-
-	// ֱTask* ɾֲָ,ûTaskڿܷǳĶ
-	// ʹָڣͬʱԶ
-	//std::queue<Task*> 
+	std::atomic_int idleThreadSize_;	// ¼̵ֻ߳DynamicSizingʹ
 
-	// Task == 
-	using Task = std::function<void()>;
-	std::queue<Task> taskQue_;        // 
-	std::atomic_int taskSize_;        // 
+	QueuePolicy taskQue_;             // 
+	MetricsPolicy metrics_;           // ͳϢ
+	std::atomic_int taskSize_;        // Ŷ
 	int taskQueMaxThreadHold_;        // ޵ֵ
 
+	int producerBufferSize_;          // ύ0ʾʹ
+	std::shared_ptr<ProducerQueue> producers_[PRODUCER_MAX_SIZE];   // ύ߳ҲУ߳˳̸߳
+	std::atomic_int producerSize_;    // Ѿύ
+	int producerCursor_;              // ߳һδĸʼ
+	uint64_t poolId_;                 // ֲ߳̾Ļ
+
 	std::mutex taskQueMtx_;       // ֤е̰߳ȫ
 	std::condition_variable notFull_;        // ʾв
 	std::condition_variable notEmpty_;        // ʾв
 
 	std::condition_variable exitCond_;    // ȴ߳Դȫ
+	std::condition_variable idleCond_;    // ȴȫִ
+	std::mutex joinMtx_;                  // shutdownʱjoiṇ߳ͬһʱֻһ
+
+	std::atomic_int activeTaskSize_;      // ִе
+	std::atomic_bool isShutdown_;         // Ѿرգٽ
 
 	PoolMode poolMode_;       // ǰ̳߳صĹģʽ
 
@@ -327,8 +1748,13 @@ private:
 
 };
 
+// Ĭϵ̳߳أ֧顢fixed/cachedģʽͳϢ
+using ThreadPool = BasicThreadPool<FairShareQueue, BlockingWait, DynamicSizing, GroupMetrics>;
+// ̳߳أ̶̣߳Уͳ
+using FixedThreadPool = BasicThreadPool<FifoQueue, BlockingWait, FixedSizing, NoMetrics>;
+
 
-// 
+//
 
 
 #endif // !THREADPOOL
@@ -0,0 +1,287 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+
+/*
+* example:
+* TaskTracer::start();
+* ...   // ̳߳
+* TaskTracer::stop();
+* TaskTracer::writeJson("trace.json");   //  https://ui.perfetto.dev  chrome://tracing 
+*/
+
+const int TRACE_BUFFER_SIZE = 1 << 16;   // ÿ̱߳¼2
+
+// ¼¼
+enum class TraceEvent {
+	ENQUEUE,    // Уύ߳
+	DEQUEUE,    // ߳ȡ
+	START,      // ʼִ
+	FINISH,     // ִ
+	SPAWN,      // ̣߳ڴ߳
+	EXIT,       // ߳˳
+	LOCK        // ̵߳ȴtaskQueMtx_
+};
+
+// ִ̳߳й̵ʱߣChrome Trace Eventʽjson
+// ÿ߳дԼĻλд˸ɵ¼¼ʱ
+// ߳˳󻺳֮½߳̽дcachedģʽ߳ʱڴ治һֱ
+// رʱÿ¼ֻһԭӶ
+class TaskTracer {
+public:
+	// ʼ¼
+	static void start() {
+		enabled_.store(true, std::memory_order_relaxed);
+	}
+
+	// ֹͣ¼Ѿ¼¼ȻԵ
+	static void stop() {
+		enabled_.store(false, std::memory_order_relaxed);
+	}
+
+	static bool enabled() {
+		return enabled_.load(std::memory_order_relaxed);
+	}
+
+	// ǰʱ䣬λns
+	static uint64_t now() {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// ¼һ¼idENQUEUESTARTnameıǩarg߳±
+	// LOCK¼idǿʼȴʱ
+	static void record(TraceEvent type, uint64_t id, const char* name, int arg) {
+		if (!enabled()) {
+			return;
+		}
+		Buffer& buf = localBuffer();
+		uint64_t h = buf.head.load(std::memory_order_relaxed);
+		// Ҫһ̶߳дʱһҲܿwriting
+		// ݴ˶ܱдһ¼
+		buf.writing.store(h + 1, std::memory_order_relaxed);
+		Slot& slot = buf.events[h & (TRACE_BUFFER_SIZE - 1)];
+		slot.ts.store(now(), std::memory_order_release);
+		slot.id.store(id, std::memory_order_release);
+		slot.name.store(name, std::memory_order_release);
+		slot.info.store(((uint64_t)type << 32) | (uint32_t)arg, std::memory_order_release);
+		buf.head.store(h + 1, std::memory_order_release);
+	}
+
+	// ̼߳¼¼дjsonڼ¼ʱ
+	static void writeJson(std::ostream& out) {
+		std::vector<std::shared_ptr<Buffer>> buffers;
+		{
+			std::unique_lock<std::mutex> lock(registryMtx());
+			buffers = registry();
+		}
+		out << "{\"traceEvents\":[\n";
+		out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"thread pool\"}}";
+		for (auto& buf : buffers) {
+			writeBuffer(out, *buf);
+		}
+		out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	}
+
+	// дļʧܷfalse
+	static bool writeJson(const std::string& path) {
+		std::ofstream out(path);
+		if (!out) {
+			std::cerr << " open trace file " << path << " fail." << std::endl;
+			return false;
+		}
+		writeJson(out);
+		return true;
+	}
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> ts;
+		std::atomic<uint64_t> id;
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> info;    // 32λͣ32λarg
+	};
+
+	// һ̵߳Ļλֻ߳д
+	// ߳˳ʱܿյ̵̣߳߳¼ͬһУʱϲص
+	struct alignas(64) Buffer {
+		std::atomic<uint64_t> head{ 0 };      // Ѿд¼
+		std::atomic<uint64_t> writing{ 0 };   // дд¼
+		int tid = 0;
+		Slot events[TRACE_BUFFER_SIZE];
+	};
+
+	static std::vector<std::shared_ptr<Buffer>>& registry() {
+		static std::vector<std::shared_ptr<Buffer>> buffers;
+		return buffers;
+	}
+	// ߳˳ʱҪõnew˳ʱ߳û˳
+	static std::mutex& registryMtx() {
+		static std::mutex* mtx = new std::mutex();
+		return *mtx;
+	}
+
+	// Ѿ˳߳ĻȻregistryregistryMtx
+	static std::vector<std::shared_ptr<Buffer>>& abandoned() {
+		static std::vector<std::shared_ptr<Buffer>>* buffers = new std::vector<std::shared_ptr<Buffer>>();
+		return *buffers;
+	}
+
+	// ߳˳ʱѻȥ
+	struct LocalBuffer {
+		std::shared_ptr<Buffer> buf;
+
+		~LocalBuffer() {
+			if (buf != nullptr) {
+				std::unique_lock<std::mutex> lock(registryMtx());
+				abandoned().push_back(std::move(buf));
+			}
+		}
+	};
+
+	// ̵߳Ļһμ¼ʱȽ˳߳µģûٴ
+	static Buffer& localBuffer() {
+		thread_local LocalBuffer local;
+		if (local.buf == nullptr) {
+			std::unique_lock<std::mutex> lock(registryMtx());
+			if (!abandoned().empty()) {
+				local.buf = std::move(abandoned().back());
+				abandoned().pop_back();
+			}
+			else {
+				// make_shared¼鲻ʼõҳ
+				local.buf = std::shared_ptr<Buffer>(new Buffer);
+				local.buf->tid = (int)registry().size() + 1;
+				registry().push_back(local.buf);
+			}
+		}
+		return *local.buf;
+	}
+
+	static void writeBuffer(std::ostream& out, Buffer& buf) {
+		uint64_t end = buf.head.load(std::memory_order_acquire);
+		uint64_t begin = end > TRACE_BUFFER_SIZE ? end - TRACE_BUFFER_SIZE : 0;
+		std::vector<Event> events;
+		events.reserve((size_t)(end - begin));
+		for (uint64_t i = begin; i < end; i++) {
+			Slot& slot = buf.events[i & (TRACE_BUFFER_SIZE - 1)];
+			Event ev;
+			ev.ts = slot.ts.load(std::memory_order_acquire);
+			ev.id = slot.id.load(std::memory_order_acquire);
+			ev.name = slot.name.load(std::memory_order_acquire);
+			uint64_t info = slot.info.load(std::memory_order_acquire);
+			ev.type = (TraceEvent)(info >> 32);
+			ev.arg = (int)(uint32_t)info;
+			events.push_back(ev);
+		}
+		// Ĺбǵ¼Ҫ
+		uint64_t writing = buf.writing.load(std::memory_order_relaxed);
+		size_t skip = 0;
+		if (writing > TRACE_BUFFER_SIZE && writing - TRACE_BUFFER_SIZE > begin) {
+			skip = (size_t)(writing - TRACE_BUFFER_SIZE - begin);
+		}
+		// ͷFINISHӦSTARTѾ
+		while (skip < events.size() && events[skip].type == TraceEvent::FINISH) {
+			skip++;
+		}
+
+		std::string threadName = "thread " + std::to_string(buf.tid);
+		for (size_t i = skip; i < events.size(); i++) {
+			TraceEvent type = events[i].type;
+			if (type == TraceEvent::START || type == TraceEvent::LOCK || type == TraceEvent::EXIT) {
+				threadName = "worker " + std::to_string(events[i].arg);
+				break;
+			}
+		}
+		out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buf.tid
+			<< ",\"args\":{\"name\":\"" << threadName << "\"}}";
+
+		for (size_t i = skip; i < events.size(); i++) {
+			writeEvent(out, buf.tid, events[i]);
+		}
+	}
+
+	struct Event {
+		uint64_t ts;
+		uint64_t id;
+		const char* name;
+		TraceEvent type;
+		int arg;
+	};
+
+	static void writeEvent(std::ostream& out, int tid, const Event& ev) {
+		out << ",\n{\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+		writeUs(out, ev.type == TraceEvent::LOCK ? ev.id : ev.ts);
+		switch (ev.type) {
+		case TraceEvent::ENQUEUE:
+			// ύһ̵ƬΪͷ
+			out << ",\"ph\":\"X\",\"dur\":0.001,\"name\":\"enqueue\",\"args\":{\"task\":";
+			writeString(out, ev.name);
+			out << ",\"group\":" << ev.arg << "}},\n{\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+			writeUs(out, ev.ts);
+			out << ",\"ph\":\"s\",\"cat\":\"task\",\"name\":\"queued\",\"id\":" << ev.id << "}";
+			break;
+		case TraceEvent::DEQUEUE:
+			out << ",\"ph\":\"i\",\"s\":\"t\",\"name\":\"dequeue\",\"args\":{\"group\":" << ev.arg << "}}";
+			break;
+		case TraceEvent::START:
+			out << ",\"ph\":\"B\",\"name\":";
+			writeString(out, ev.name);
+			out << "},\n{\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+			writeUs(out, ev.ts);
+			out << ",\"ph\":\"f\",\"bp\":\"e\",\"cat\":\"task\",\"name\":\"queued\",\"id\":" << ev.id << "}";
+			break;
+		case TraceEvent::FINISH:
+			out << ",\"ph\":\"E\"}";
+			break;
+		case TraceEvent::SPAWN:
+			out << ",\"ph\":\"i\",\"s\":\"p\",\"name\":\"spawn worker " << ev.arg << "\"}";
+			break;
+		case TraceEvent::EXIT:
+			out << ",\"ph\":\"i\",\"s\":\"p\",\"name\":\"exit worker " << ev.arg << "\"}";
+			break;
+		case TraceEvent::LOCK:
+			// Ƭδӿʼȴõ
+			out << ",\"ph\":\"X\",\"name\":\"lock wait\",\"dur\":";
+			writeUs(out, ev.ts > ev.id ? ev.ts - ev.id : 0);
+			out << "}";
+			break;
+		}
+	}
+
+	// Chrome traceʱ䵥λus
+	static void writeUs(std::ostream& out, uint64_t ns) {
+		out << ns / 1000 << '.';
+		uint64_t frac = ns % 1000;
+		out << (char)('0' + frac / 100) << (char)('0' + frac / 10 % 10) << (char)('0' + frac % 10);
+	}
+
+	static void writeString(std::ostream& out, const char* s) {
+		out << '"';
+		for (; s != nullptr && *s != '\0'; s++) {
+			if (*s == '"' || *s == '\\') {
+				out << '\\';
+			}
+			if ((unsigned char)*s < 0x20) {
+				continue;
+			}
+			out << *s;
+		}
+		out << '"';
+	}
+
+private:
+	static inline std::atomic_bool enabled_{ false };
+};
+
+
+#endif // !TRACER_H
@@ -0,0 +1,114 @@
+#ifndef WORKERLOCAL_H
+#define WORKERLOCAL_H
+
+#include <memory>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <cassert>
+#include "threadpool.h"
+
+/*
+* example:
+* ThreadPool pool;
+* pool.start(4);
+* WorkerLocal<long> partial(pool);
+* for (int i = 0; i < 1000; i++) {
+*	pool.submitTask([&partial, i]() { partial.local() += i; });
+* }
+* pool.awaitIdle();
+* long sum = partial.combine([](long a, long b) { return a + b; });
+*/
+// ÿ߳һݵݣ̵߳Ĳλ±ţʲҪ
+// ÿݵռУһηʱŹ
+// ̳߳start֮󴴽
+// cachedģʽյ߳µݻᱣɸͬһλ߳̽
+// ̳߳ص̷߳local()ʱһݣͬһʱֻһ߳
+template<typename T, typename Pool = ThreadPool>
+class WorkerLocal {
+public:
+	// ÿĬϹ
+	explicit WorkerLocal(Pool& pool) :WorkerLocal(pool, []() { return T(); }) {}
+
+	// ÿinit
+	template<typename Init>
+	WorkerLocal(Pool& pool, Init init) :
+		pool_(pool),
+		init_(std::move(init)),
+		size_(pool.workerCapacity() + 1),
+		slots_(std::make_unique<Slot[]>(size_))
+	{}
+
+	WorkerLocal(const WorkerLocal&) = delete;
+	WorkerLocal& operator=(const WorkerLocal&) = delete;
+
+	// ǰ̵߳Ƿݣһηʱ
+	// start֮ǰWorkerLocalֻⲿ̵߳һݣ̵߳±Խ磬
+	// ԰ֱӶԣ˻صⲿ̵߳һ
+	T& local() {
+		int index = pool_.localWorkerIndex();
+		assert(index < size_ - 1 && "WorkerLocal must be created after the pool is started");
+		Slot& slot = slots_[index < 0 || index >= size_ - 1 ? size_ - 1 : index];
+		if (!slot.value) {
+			slot.value.emplace(init_());
+		}
+		return *slot.value;
+	}
+
+	// Ѿݣڲн׶ν󣨱awaitIdle֮󣩵
+	template<typename Fn>
+	void forEach(Fn fn) {
+		for (int i = 0; i < size_; i++) {
+			if (slots_[i].value) {
+				fn(*slots_[i].value);
+			}
+		}
+	}
+
+	// opѾݺϲһһݶûʱĬֵ
+	template<typename BinaryOp>
+	T combine(BinaryOp op) {
+		std::optional<T> result;
+		forEach([&](T& value) {
+			if (result) {
+				result.emplace(op(std::move(*result), value));
+			}
+			else {
+				result.emplace(value);
+			}
+			});
+		return result ? std::move(*result) : T();
+	}
+
+	// Ѿݷ
+	int size() const {
+		int n = 0;
+		for (int i = 0; i < size_; i++) {
+			if (slots_[i].value) {
+				n++;
+			}
+		}
+		return n;
+	}
+
+	// ݣ´η¹죬ֻͬڲн׶֮
+	void clear() {
+		for (int i = 0; i < size_; i++) {
+			slots_[i].value.reset();
+		}
+	}
+
+private:
+	// ж룬̵ͬ߳ݲͬһ
+	struct alignas(CACHE_LINE_SIZE) Slot {
+		std::optional<T> value;
+	};
+
+	Pool& pool_;
+	std::function<T()> init_;
+	int size_;                          // ̲߳λϸⲿ̵߳һ
+	std::unique_ptr<Slot[]> slots_;
+};
+
+
+#endif // !WORKERLOCAL_H
@@ -3,6 +3,7 @@
 #include <functional>
 #include <future> 
 #include <chrono>
+#define THREADPOOL_DEBUG    // 打印线程池的调试日志
 #include "threadpool.h"
 using namespace std;
 
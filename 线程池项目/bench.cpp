@@ -0,0 +1,135 @@
+﻿// Task/Result接口的性能测试，和演示程序分开编译：
+// g++ -O2 -std=c++17 -pthread bench.cpp threadpool.cpp -o bench
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <memory>
+#include "threadpool.h"
+
+using Clock = std::chrono::steady_clock;
+using uLong = unsigned long long;
+
+const int BENCH_SIZE = 200000;
+
+// 改造之前的Any：每个值一次堆分配，dynamic_cast取值
+class HeapAny {
+public:
+    HeapAny() = default;
+    HeapAny(HeapAny&&) = default;
+    HeapAny& operator=(HeapAny&&) = default;
+
+    template<typename T>
+    HeapAny(T data) :base_(std::make_unique<Derive<T>>(data)) {}
+
+    template <typename T>
+    T cast_() {
+        Derive<T>* pd = dynamic_cast<Derive<T>*>(base_.get());
+        if (pd == nullptr) {
+            throw "type is unmatch!";
+        }
+        return pd->data_;
+    }
+private:
+    class Base {
+    public:
+        virtual ~Base() = default;
+    };
+    template<typename T>
+    class Derive :public Base {
+    public:
+        Derive(T data) :data_(data) {}
+        T data_;
+    };
+    std::unique_ptr<Base> base_;
+};
+
+// 改造之前的Result：信号量 + 堆分配的Any
+struct SemaphoreResult {
+    HeapAny any_;
+    Semaphore sem_;
+};
+
+// 改造之后的Result：原子状态 + 小对象缓冲区的Any
+struct EventResult {
+    Any any_;
+    OnceEvent done_;
+};
+
+double nsPerOp(Clock::time_point begin, Clock::time_point end) {
+    return std::chrono::duration<double, std::nano>(end - begin).count() / BENCH_SIZE;
+}
+
+// 存一个返回值再取出来
+template<typename AnyType>
+double benchAny() {
+    uLong sum = 0;
+    auto begin = Clock::now();
+    for (int i = 0; i < BENCH_SIZE; i++) {
+        AnyType any(static_cast<uLong>(i));
+        AnyType moved(std::move(any));
+        sum += moved.template cast_<uLong>();
+    }
+    auto end = Clock::now();
+    if (sum == 0) {
+        std::cout << "";
+    }
+    return nsPerOp(begin, end);
+}
+
+// 一个线程逐个设置返回值，另一个线程逐个get，每个结果只用一次
+double benchSemaphoreResult() {
+    std::vector<std::unique_ptr<SemaphoreResult>> results(BENCH_SIZE);
+    for (auto& res : results) {
+        res = std::make_unique<SemaphoreResult>();
+    }
+    auto begin = Clock::now();
+    std::thread producer([&]() {
+        for (int i = 0; i < BENCH_SIZE; i++) {
+            results[i]->any_ = HeapAny(uLong(i));
+            results[i]->sem_.post();
+        }
+        });
+    uLong sum = 0;
+    for (int i = 0; i < BENCH_SIZE; i++) {
+        results[i]->sem_.wait();
+        sum += results[i]->any_.cast_<uLong>();
+    }
+    auto end = Clock::now();
+    producer.join();
+    return nsPerOp(begin, end);
+}
+
+double benchEventResult() {
+    std::vector<std::unique_ptr<EventResult>> results(BENCH_SIZE);
+    for (auto& res : results) {
+        res = std::make_unique<EventResult>();
+    }
+    auto begin = Clock::now();
+    std::thread producer([&]() {
+        for (int i = 0; i < BENCH_SIZE; i++) {
+            results[i]->any_ = Any(uLong(i));
+            results[i]->done_.set();
+        }
+        });
+    uLong sum = 0;
+    for (int i = 0; i < BENCH_SIZE; i++) {
+        results[i]->done_.wait();
+        sum += results[i]->any_.cast_<uLong>();
+    }
+    auto end = Clock::now();
+    producer.join();
+    return nsPerOp(begin, end);
+}
+
+int main()
+{
+    std::cout << "==== Any: store + move + cast_ ====" << std::endl;
+    std::cout << "heap Any   " << benchAny<HeapAny>() << " ns/op" << std::endl;
+    std::cout << "inline Any " << benchAny<Any>() << " ns/op" << std::endl;
+
+    std::cout << "==== Result: setVal on one thread, get on another ====" << std::endl;
+    std::cout << "Semaphore  " << benchSemaphoreResult() << " ns/op" << std::endl;
+    std::cout << "OnceEvent  " << benchEventResult() << " ns/op" << std::endl;
+    return 0;
+}
@@ -2,6 +2,14 @@
 #include <functional>
 #include <thread>
 #include <iostream>
+#if defined(_WIN32)
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
  
 const int TASK_MAX_THREADHOLD = INT32_MAX;
 const int THREAD_MAX_THREADHOLD = 1024;
@@ -252,6 +260,56 @@ int Thread::getId() const {
 	return threadId_;
 }
 
+////////////////////////// OnceEventʵ   //////////////////////////////
+// ȴĴִܿʱԲں
+const int EVENT_SPIN_COUNT = 1000;
+
+// addr˯ߣֱ*addr != expected߱
+static void futexWait(std::atomic_int* addr, int expected) {
+#if defined(_WIN32)
+	WaitOnAddress(addr, &expected, sizeof(int), INFINITE);
+#elif defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+	std::this_thread::yield();
+#endif
+}
+
+// ˯addrϵ߳
+static void futexWakeAll(std::atomic_int* addr) {
+#if defined(_WIN32)
+	WakeByAddressAll(addr);
+#elif defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+	(void)addr;
+#endif
+}
+
+void OnceEvent::wait() {
+	for (int i = 0; i < EVENT_SPIN_COUNT; i++) {
+		if (state_.load(std::memory_order_acquire) == EVENT_SET) {
+			return;
+		}
+	}
+	for (;;) {
+		int state = EVENT_PENDING;
+		// ߳˯ߣsetʱ֪Ҫ
+		if (state_.compare_exchange_strong(state, EVENT_WAITING) || state == EVENT_WAITING) {
+			futexWait(&state_, EVENT_WAITING);
+		}
+		else if (state == EVENT_SET) {
+			return;
+		}
+	}
+}
+
+void OnceEvent::set() {
+	if (state_.exchange(EVENT_SET, std::memory_order_acq_rel) == EVENT_WAITING) {
+		futexWakeAll(&state_);
+	}
+}
+
 ////////////////////////// Taskʵ   //////////////////////////////
 Task::Task():result_(nullptr){}
 
@@ -277,7 +335,7 @@ Any Result::get() {
 	if (!isValid_) {
 		return "";
 	}
-	sem_.wait();   // taskûִ꣬û߳
+	done_.wait();   // taskûִ꣬û߳
 	return std::move(any_);
 }
 
@@ -285,6 +343,6 @@ Any Result::get() {
 void Result::setVal(Any any) {
 	// 洢taskķֵ
 	this->any_ = std::move(any);
-	sem_.post();   // ѾȡķֵźԴ
+	done_.set();   // Ѿȡķֵ֪ͨȴ߳
 
 }
\ No newline at end of file
@@ -9,50 +9,127 @@
 #include <condition_variable>    // 
 #include <functional>
 #include <unordered_map>
+#include <thread>
+#include <type_traits>
+#include <new>
+#include <cstddef>
 
 // AnyͣԽݵ
+// СֱӷڲĻҪѷ
+// ͼȽÿΨһĵַRTTI
 class Any {
 public:
-	Any() = default;
-	~Any() = default;
+	Any() :ops_(nullptr) {}
+	~Any() {
+		reset();
+	}
 	Any(const Any&) = delete;
 	Any& operator=(const Any&) = delete;
-	Any(Any&&) = default;
-	Any& operator=(Any&&) = default;
+	Any(Any&& other) noexcept :ops_(nullptr) {
+		moveFrom(other);
+	}
+	Any& operator=(Any&& other) noexcept {
+		if (this != &other) {
+			reset();
+			moveFrom(other);
+		}
+		return *this;
+	}
 
 	// 캯Any
-	template<typename T>
-	Any(T data) :base_(std::make_unique<Derive<T>>(data)) {} 
+	template<typename T, typename = std::enable_if_t<!std::is_same<std::decay_t<T>, Any>::value>>
+	Any(T data) :ops_(&Holder<T>::ops) {
+		Holder<T>::create(*this, std::move(data));
+	}
 
 	// ܰAny洢dataȡ
 	template <typename T>
 	T cast_() {
-		// ôbase_ҵָDerive󣬴ȡdataԱ
-		// ָתΪָ RTTI
-		Derive<T>* pd = dynamic_cast<Derive<T>*>(base_.get());
-		if (pd == nullptr) {
+		if (ops_ == nullptr || ops_->type != typeId<T>()) {
 			throw "type is unmatch!";
 		}
-		return pd->data_;
+		return *Holder<T>::get(*this);
 	}
 private:
-	// 
-	class Base {
-	public:
-		virtual ~Base() = default;
+	// ڲĴСŵµͲҪѷ
+	static const size_t BUF_SIZE = 3 * sizeof(void*);
+
+	// ÿ͵Ĳ麯
+	struct Ops {
+		const void* type;                    // ͱʶ
+		void (*destroy)(Any& self);
+		void (*move)(Any& dst, Any& src);    // srcƵdstĻ
 	};
 
-	// 
+	// ÿһΨһľ̬ĵַͱʶ
 	template<typename T>
-	class Derive :public Base {
-	public:
-		Derive(T data) :data_(data) {}
-		T data_;   // 
+	static const void* typeId() {
+		static const char id = 0;
+		return &id;
+	}
+
+	template<typename T>
+	struct Holder {
+		// ܷŽƶ쳣
+		static const bool small = sizeof(T) <= BUF_SIZE && alignof(T) <= alignof(std::max_align_t)
+			&& std::is_nothrow_move_constructible<T>::value;
+
+		static T* get(Any& self) {
+			if (small) {
+				return reinterpret_cast<T*>(&self.buf_);
+			}
+			return *reinterpret_cast<T**>(&self.buf_);
+		}
+		static void create(Any& self, T&& data) {
+			if (small) {
+				new (&self.buf_) T(std::move(data));
+			}
+			else {
+				*reinterpret_cast<T**>(&self.buf_) = new T(std::move(data));
+			}
+		}
+		static void destroy(Any& self) {
+			if (small) {
+				get(self)->~T();
+			}
+			else {
+				delete get(self);
+			}
+		}
+		static void move(Any& dst, Any& src) {
+			if (small) {
+				new (&dst.buf_) T(std::move(*get(src)));
+				get(src)->~T();
+			}
+			else {
+				*reinterpret_cast<T**>(&dst.buf_) = get(src);
+			}
+		}
+		static const Ops ops;
 	};
 
+	void reset() {
+		if (ops_ != nullptr) {
+			ops_->destroy(*this);
+			ops_ = nullptr;
+		}
+	}
+	void moveFrom(Any& other) {
+		if (other.ops_ != nullptr) {
+			other.ops_->move(*this, other);
+			ops_ = other.ops_;
+			other.ops_ = nullptr;
+		}
+	}
+
 private:
-	// һָ
-	std::unique_ptr<Base> base_;
+	const Ops* ops_;   // Ϊձʾûд
+	typename std::aligned_storage<BUF_SIZE, alignof(std::max_align_t)>::type buf_;
+};
+
+template<typename T>
+const Any::Ops Any::Holder<T>::ops = {
+	Any::typeId<T>(), &Any::Holder<T>::destroy, &Any::Holder<T>::move
 };
 
 // ʵһź
@@ -84,6 +161,31 @@ private:
 	std::condition_variable cond_;
 };
 
+// һԵֻ֪ͨsetһ
+// һԭ״̬滥+ȴ߳״̬futex˯
+class OnceEvent {
+public:
+	OnceEvent() :state_(EVENT_PENDING) {}
+	~OnceEvent() = default;
+	OnceEvent(const OnceEvent&) = delete;
+	OnceEvent& operator=(const OnceEvent&) = delete;
+
+	// ȴ¼
+	void wait();
+	// ɣ߳˯߲Ҫϵͳû
+	void set();
+	bool isSet() const {
+		return state_.load(std::memory_order_acquire) == EVENT_SET;
+	}
+private:
+	enum {
+		EVENT_PENDING,   // û
+		EVENT_SET,       // Ѿ
+		EVENT_WAITING    // ûɣ߳˯
+	};
+	std::atomic_int state_;
+};
+
 // Task͵ǰ
 class Task;
 // ʵύ̳߳صtaskִɺķֵ Result
@@ -98,7 +200,7 @@ public:
 	Any get();
 private:
 	Any any_;  // 洢ķֵ
-	Semaphore sem_;    // ߳ͨź
+	OnceEvent done_;    // ִɵ֪ͨ
 	std::shared_ptr<Task> task_;  // ִжӦȡֵ
 	std::atomic_bool isValid_;
 };